@@ -0,0 +1,482 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include "WorkerPool.hpp"
+#if defined(_WIN32)
+//the includers of WorkerPool.hpp get windows.h too, keep it to the core APIs and without the min/max macros
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define WORKERPOOL_IO_URING 1
+#endif
+
+namespace ms
+{
+	/*
+	* Where the file operations of AsyncFileIo are carried out
+	* Auto - io_uring where the kernel offers it (Linux 5.6 and later, and not forbidden by a seccomp profile), Threads otherwise
+	* IoUring - io_uring only, the constructor throws std::system_error if it is not available
+	* Threads - plain blocking calls on a few threads of a small pool of their own, never on the workers of the main pool
+	* */
+	enum class IoBackend
+	{
+		Auto,
+		IoUring,
+		Threads
+	};
+
+	struct IoOptions
+	{
+		IoBackend backend = IoBackend::Auto;
+		//operations in flight at most (io_uring ring size), a submission waits for room beyond that
+		unsigned int queue_depth = 256;
+		//threads of the blocking fallback
+		unsigned int blocking_threads = 2;
+	};
+
+	//outcome of an operation: the bytes transferred (fewer than asked at the end of a file), or the error
+	struct IoResult
+	{
+		size_t bytes = 0;
+		std::error_code error;
+
+		explicit operator bool() const noexcept { return !error; }
+	};
+
+	/*
+	* Asynchronous reads, writes and fsync at an offset of an open file, into and out of caller buffers.
+	* The callback (void(IoResult)) is posted to the pool as a task once the operation is over, so workers stay busy with
+	* CPU work while the I/O is in flight and no worker ever blocks on a file. The buffer must stay valid until then.
+	*
+	* With io_uring one thread waits for all the completions, with the Threads backend the blocking calls run on a small
+	* pool of their own. Either way the number of threads does not depend on the number of operations in flight.
+	* Exceptions thrown by the callbacks are swallowed, as with WorkerPool::Post.
+	* The destructor waits for the operations in flight and their callbacks, it has to run before the pool is destroyed.
+	* */
+	class AsyncFileIo
+	{
+	public:
+#if defined(_WIN32)
+		using NativeFile = HANDLE;
+#else
+		using NativeFile = int;
+#endif
+
+		explicit AsyncFileIo(WorkerPool& pool, const IoOptions& options = IoOptions{})
+			: pool(pool), depth(std::max(options.queue_depth, 1u))
+		{
+#if defined(WORKERPOOL_IO_URING)
+			if (options.backend != IoBackend::Threads)
+			{
+				auto error = SetupRing();
+				if (!error)
+				{
+					backend = IoBackend::IoUring;
+					reaper = std::thread(&AsyncFileIo::Reap, this);
+					return;
+				}
+				if (options.backend == IoBackend::IoUring)
+					throw std::system_error(error, "io_uring setup");
+			}
+#else
+			if (options.backend == IoBackend::IoUring)
+				throw std::system_error(std::make_error_code(std::errc::function_not_supported), "io_uring setup");
+#endif
+			backend = IoBackend::Threads;
+			blocking.emplace(std::max(options.blocking_threads, 1u));
+		}
+
+		AsyncFileIo(const AsyncFileIo&) = delete;
+		AsyncFileIo& operator = (const AsyncFileIo&) = delete;
+
+		~AsyncFileIo()
+		{
+			if (pool.CurrentWorkerIndex() >= 0)
+				pool.HelpWhile([this] { return !pending.IsZero(); });
+			//the task which finished the last operation may still be in Done
+			pending.Wait();
+			blocking.reset();
+#if defined(WORKERPOOL_IO_URING)
+			if (backend == IoBackend::IoUring)
+				CloseRing();
+#endif
+		}
+
+		[[nodiscard]] IoBackend Backend() const noexcept { return backend; }
+
+		template <typename F>
+		void Read(NativeFile file, void* buffer, size_t size, uint64_t offset, F&& on_done)
+		{
+			Submit(Operation::Kind::Read, file, buffer, size, offset, std::forward<F>(on_done));
+		}
+
+		template <typename F>
+		void Write(NativeFile file, const void* buffer, size_t size, uint64_t offset, F&& on_done)
+		{
+			Submit(Operation::Kind::Write, file, const_cast<void*>(buffer), size, offset, std::forward<F>(on_done));
+		}
+
+		//flushes the file's data and metadata to the device
+		template <typename F>
+		void Fsync(NativeFile file, F&& on_done)
+		{
+			Submit(Operation::Kind::Fsync, file, nullptr, 0, 0, std::forward<F>(on_done));
+		}
+
+	private:
+		struct Operation
+		{
+			enum class Kind : uint8_t
+			{
+				Read,
+				Write,
+				Fsync
+			};
+
+			Kind kind = Kind::Read;
+			NativeFile file{};
+			void* buffer = nullptr;
+			size_t size = 0;
+			uint64_t offset = 0;
+			IoResult result;
+			Task on_done; //reads result
+		};
+
+		template <typename F>
+		void Submit(typename Operation::Kind kind, NativeFile file, void* buffer, size_t size, uint64_t offset, F&& on_done)
+		{
+			auto op = operations.Acquire(RecyclingPool<Operation>::no_cache);
+			try
+			{
+				op->on_done = [f = std::forward<F>(on_done), result = &op->result]() mutable { f(*result); };
+			}
+			catch (...)
+			{
+				operations.Release(op, RecyclingPool<Operation>::no_cache);
+				throw;
+			}
+			op->kind = kind;
+			op->file = file;
+			op->buffer = buffer;
+			op->size = size;
+			op->offset = offset;
+			op->result = IoResult{};
+			pending.Add();
+
+#if defined(WORKERPOOL_IO_URING)
+			if (backend == IoBackend::IoUring)
+			{
+				SubmitToRing(op);
+				return;
+			}
+#endif
+			try
+			{
+				blocking->Post([this, op] {
+					RunBlocking(*op);
+					Dispatch(op);
+				});
+			}
+			catch (...)
+			{
+				Finish(op);
+				throw;
+			}
+		}
+
+		//posts the callback to the pool, or runs it right here if the pool is stopping
+		void Dispatch(Operation* op) noexcept
+		{
+			try
+			{
+				pool.Post([this, op] { Complete(op); });
+			}
+			catch (...)
+			{
+				Complete(op);
+			}
+		}
+
+		void Complete(Operation* op) noexcept
+		{
+			try
+			{
+				op->on_done();
+			}
+			catch (...)
+			{
+
+			}
+			Finish(op);
+		}
+
+		void Finish(Operation* op) noexcept
+		{
+			op->on_done.Reset();
+			operations.Release(op, RecyclingPool<Operation>::no_cache);
+			pending.Done();
+		}
+
+		static void RunBlocking(Operation& op) noexcept
+		{
+#if defined(_WIN32)
+			OVERLAPPED at{};
+			at.Offset = static_cast<DWORD>(op.offset);
+			at.OffsetHigh = static_cast<DWORD>(op.offset >> 32);
+			DWORD transferred = 0;
+			BOOL ok = TRUE;
+			auto size = static_cast<DWORD>(std::min<size_t>(op.size, 0xFFFFFFFFu));
+			switch (op.kind)
+			{
+			case Operation::Kind::Read:
+				ok = ReadFile(op.file, op.buffer, size, &transferred, &at);
+				//a read at the end of the file is not an error, it transfers nothing
+				if (!ok && GetLastError() == ERROR_HANDLE_EOF)
+					ok = TRUE;
+				break;
+			case Operation::Kind::Write:
+				ok = WriteFile(op.file, op.buffer, size, &transferred, &at);
+				break;
+			case Operation::Kind::Fsync:
+				ok = FlushFileBuffers(op.file);
+				break;
+			}
+			if (ok)
+				op.result.bytes = transferred;
+			else
+				op.result.error = std::error_code(static_cast<int>(GetLastError()), std::system_category());
+#else
+			ssize_t done = 0;
+			do
+			{
+				switch (op.kind)
+				{
+				case Operation::Kind::Read:
+					done = ::pread(op.file, op.buffer, op.size, static_cast<off_t>(op.offset));
+					break;
+				case Operation::Kind::Write:
+					done = ::pwrite(op.file, op.buffer, op.size, static_cast<off_t>(op.offset));
+					break;
+				case Operation::Kind::Fsync:
+					done = ::fsync(op.file);
+					break;
+				}
+			} while (done < 0 && errno == EINTR);
+			if (done >= 0)
+				op.result.bytes = static_cast<size_t>(done);
+			else
+				op.result.error = std::error_code(errno, std::system_category());
+#endif
+		}
+
+#if defined(WORKERPOOL_IO_URING)
+		/*
+		* The ring is driven with the raw system calls, no liburing needed. Submitters fill a submission entry under
+		* submit_mx and enter the kernel right away (no SQPOLL thread), the reaper thread is the only reader of the
+		* completion ring. At most depth operations are in flight so the completion ring (twice as large) never overflows.
+		* */
+		std::error_code SetupRing() noexcept
+		{
+			io_uring_params params{};
+			ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, depth, &params));
+			if (ring_fd < 0)
+				return std::error_code(errno, std::system_category());
+			//plain IORING_OP_READ/WRITE need 5.6, which is also when IORING_FEAT_NODROP showed up
+			if (!(params.features & IORING_FEAT_NODROP) || !(params.features & IORING_FEAT_SINGLE_MMAP))
+			{
+				::close(ring_fd);
+				return std::make_error_code(std::errc::function_not_supported);
+			}
+
+			ring_size = std::max<size_t>(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+				params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+			ring = ::mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+			if (ring == MAP_FAILED)
+			{
+				auto error = std::error_code(errno, std::system_category());
+				::close(ring_fd);
+				return error;
+			}
+			sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+			sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+			if (sqes == MAP_FAILED)
+			{
+				auto error = std::error_code(errno, std::system_category());
+				::munmap(ring, ring_size);
+				::close(ring_fd);
+				return error;
+			}
+
+			auto base = static_cast<char*>(ring);
+			sq_tail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+			sq_mask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+			sq_array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+			cq_head = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+			cq_tail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+			cq_mask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+			cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+			depth = params.sq_entries;
+			return {};
+		}
+
+		int Enter(unsigned int to_submit, unsigned int min_complete, unsigned int flags) noexcept
+		{
+			return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+		}
+
+		void SubmitToRing(Operation* op)
+		{
+			//room in the ring, released by the reaper
+			for (auto f = in_flight.load(std::memory_order_acquire);;)
+			{
+				if (f >= depth)
+				{
+					in_flight.wait(f, std::memory_order_acquire);
+					f = in_flight.load(std::memory_order_acquire);
+				}
+				else if (in_flight.compare_exchange_weak(f, f + 1, std::memory_order_acq_rel))
+				{
+					break;
+				}
+			}
+
+			std::unique_lock lk(submit_mx);
+			auto tail = *sq_tail;
+			auto index = tail & sq_mask;
+			auto& sqe = sqes[index];
+			std::memset(&sqe, 0, sizeof(sqe));
+			switch (op->kind)
+			{
+			case Operation::Kind::Read:
+				sqe.opcode = IORING_OP_READ;
+				break;
+			case Operation::Kind::Write:
+				sqe.opcode = IORING_OP_WRITE;
+				break;
+			case Operation::Kind::Fsync:
+				sqe.opcode = IORING_OP_FSYNC;
+				break;
+			}
+			sqe.fd = op->file;
+			sqe.addr = reinterpret_cast<uint64_t>(op->buffer);
+			sqe.len = static_cast<uint32_t>(std::min<size_t>(op->size, 0x7FFFF000u));
+			sqe.off = op->offset;
+			sqe.user_data = reinterpret_cast<uint64_t>(op);
+			sq_array[index] = index;
+			std::atomic_ref(*sq_tail).store(tail + 1, std::memory_order_release);
+
+			int submitted = 0;
+			while ((submitted = Enter(1, 0, 0)) < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+				std::this_thread::yield();
+			if (submitted < 0)
+			{
+				//the kernel did not take the entry, take it back and fail the operation
+				auto error = errno;
+				std::atomic_ref(*sq_tail).store(tail, std::memory_order_release);
+				lk.unlock();
+				in_flight.fetch_sub(1, std::memory_order_release);
+				in_flight.notify_one();
+				op->result.error = std::error_code(error, std::system_category());
+				Dispatch(op);
+			}
+		}
+
+		//the only reader of the completion ring, a completion without an operation (the stop nop) ends it
+		void Reap() noexcept
+		{
+			while (true)
+			{
+				auto head = *cq_head;
+				auto tail = std::atomic_ref(*cq_tail).load(std::memory_order_acquire);
+				if (head == tail)
+				{
+					Enter(0, 1, IORING_ENTER_GETEVENTS);
+					continue;
+				}
+				for (; head != tail; head++)
+				{
+					auto& cqe = cqes[head & cq_mask];
+					auto op = reinterpret_cast<Operation*>(cqe.user_data);
+					auto res = cqe.res;
+					std::atomic_ref(*cq_head).store(head + 1, std::memory_order_release);
+					if (!op)
+						return;
+
+					//acquire pairs with the submitter's increment, which published op (the ring itself is invisible to tools like TSAN)
+					in_flight.fetch_sub(1, std::memory_order_acq_rel);
+					in_flight.notify_one();
+					if (res >= 0)
+						op->result.bytes = static_cast<size_t>(res);
+					else
+						op->result.error = std::error_code(-res, std::system_category());
+					Dispatch(op);
+				}
+			}
+		}
+
+		void CloseRing() noexcept
+		{
+			//every operation is over, a nop tells the reaper to leave
+			{
+				std::unique_lock lk(submit_mx);
+				auto tail = *sq_tail;
+				auto index = tail & sq_mask;
+				std::memset(&sqes[index], 0, sizeof(io_uring_sqe));
+				sqes[index].opcode = IORING_OP_NOP;
+				sq_array[index] = index;
+				std::atomic_ref(*sq_tail).store(tail + 1, std::memory_order_release);
+				while (Enter(1, 0, 0) < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+					std::this_thread::yield();
+			}
+			reaper.join();
+			::munmap(sqes, sqes_size);
+			::munmap(ring, ring_size);
+			::close(ring_fd);
+		}
+
+		std::mutex submit_mx;
+		int ring_fd = -1;
+		void* ring = nullptr;
+		size_t ring_size = 0;
+		io_uring_sqe* sqes = nullptr;
+		size_t sqes_size = 0;
+		unsigned* sq_tail = nullptr;
+		unsigned sq_mask = 0;
+		unsigned* sq_array = nullptr;
+		unsigned* cq_head = nullptr;
+		unsigned* cq_tail = nullptr;
+		unsigned cq_mask = 0;
+		io_uring_cqe* cqes = nullptr;
+		std::atomic<unsigned int> in_flight{ 0 };
+		std::thread reaper;
+#endif
+
+		WorkerPool& pool;
+		unsigned int depth;
+		IoBackend backend = IoBackend::Threads;
+		std::optional<WorkerPool> blocking;
+		RecyclingPool<Operation> operations{ 0 };
+		TaskCounter pending;
+	};
+}
@@ -0,0 +1,235 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "RecyclingPool.hpp"
+
+namespace ms
+{
+	/*
+	* Completion slot shared between a CompletionHandle and the task(s) it tracks.
+	* Slots are owned by the pool and recycled, so tracking a task costs no allocation once the pool is warmed up.
+	* There are two references on a slot: the handle and the tracked tasks (released when the last of them finishes).
+	* */
+	class CompletionState
+	{
+	public:
+		//results of up to this size (see WorkerPool::Submit) live in the slot itself, bigger ones in a heap box
+		static constexpr size_t result_size = 48;
+
+		template <typename R>
+		static constexpr bool result_inline = sizeof(R) <= result_size && alignof(R) <= alignof(std::max_align_t)
+			&& std::is_nothrow_move_constructible_v<R>;
+
+		void Reset(uint32_t task_count, RecyclingPool<CompletionState>* owner) noexcept
+		{
+			pending.store(task_count, std::memory_order_relaxed);
+			references.store(2, std::memory_order_relaxed);
+			failed.store(false, std::memory_order_relaxed);
+			error = nullptr;
+			home = owner;
+		}
+
+		//called once per tracked task, cache_index is the worker index of the caller (see RecyclingPool)
+		void TaskFinished(std::exception_ptr task_error, size_t cache_index) noexcept
+		{
+			//only the first failure is kept, it is published by the release on 'pending'
+			if (task_error && !failed.exchange(true, std::memory_order_relaxed))
+				error = std::move(task_error);
+
+			if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				pending.notify_all();
+				Unref(cache_index);
+			}
+		}
+
+		[[nodiscard]] bool IsDone() const noexcept { return pending.load(std::memory_order_acquire) == 0; }
+
+		void Wait() const noexcept
+		{
+			for (auto p = pending.load(std::memory_order_acquire); p != 0; p = pending.load(std::memory_order_acquire))
+			{
+				pending.wait(p, std::memory_order_acquire);
+			}
+		}
+
+		[[nodiscard]] const std::exception_ptr& Error() const noexcept { return error; }
+
+		//called by the tracked task before TaskFinished, which publishes the result
+		template <typename R, typename... Args>
+		void EmplaceResult(Args&&... args)
+		{
+			if constexpr (result_inline<R>)
+			{
+				new (result) R(std::forward<Args>(args)...);
+				destroy_result = [](void* storage) noexcept { std::launder(static_cast<R*>(storage))->~R(); };
+			}
+			else
+			{
+				new (result) R*(new R(std::forward<Args>(args)...));
+				destroy_result = [](void* storage) noexcept { delete *std::launder(static_cast<R**>(storage)); };
+			}
+		}
+
+		//only after Wait, and only if the task succeeded
+		template <typename R>
+		[[nodiscard]] R& Result() noexcept
+		{
+			if constexpr (result_inline<R>)
+				return *std::launder(reinterpret_cast<R*>(result));
+			else
+				return **std::launder(reinterpret_cast<R**>(result));
+		}
+
+		void Unref(size_t cache_index) noexcept
+		{
+			if (references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				error = nullptr;
+				if (destroy_result)
+					std::exchange(destroy_result, nullptr)(result);
+				home->Release(this, cache_index);
+			}
+		}
+
+	private:
+		std::atomic<uint32_t> pending{ 0 };
+		std::atomic<uint32_t> references{ 0 };
+		std::atomic<bool> failed{ false };
+		std::exception_ptr error;
+		RecyclingPool<CompletionState>* home = nullptr;
+		void (*destroy_result)(void*) noexcept = nullptr;
+		alignas(std::max_align_t) unsigned char result[result_size];
+	};
+
+	/*
+	* Cheap alternative to std::future<void>, returned by WorkerPool::PostWithHandle.
+	* Waiting uses C++20 atomic wait on the pool owned slot, there is no shared state allocation and no mutex/condition variable.
+	* A handle must not outlive the pool which created it.
+	* */
+	class CompletionHandle
+	{
+	public:
+		CompletionHandle() noexcept = default;
+		explicit CompletionHandle(CompletionState* state) noexcept : state(state) {}
+		CompletionHandle(CompletionHandle&& other) noexcept : state(std::exchange(other.state, nullptr)) {}
+		CompletionHandle& operator = (CompletionHandle&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Release();
+				state = std::exchange(other.state, nullptr);
+			}
+			return *this;
+		}
+		CompletionHandle(const CompletionHandle&) = delete;
+		CompletionHandle& operator = (const CompletionHandle&) = delete;
+		~CompletionHandle()
+		{
+			Release();
+		}
+
+		[[nodiscard]] bool Valid() const noexcept { return state != nullptr; }
+
+		[[nodiscard]] bool IsDone() const noexcept { return state->IsDone(); }
+
+		/*
+		* Blocks until the tracked task(s) have finished.
+		* If any of them threw, the first exception is rethrown here.
+		* */
+		void Wait() const
+		{
+			state->Wait();
+			if (state->Error())
+				std::rethrow_exception(state->Error());
+		}
+
+	protected:
+		[[nodiscard]] CompletionState* State() const noexcept { return state; }
+
+	private:
+		void Release() noexcept
+		{
+			if (state)
+			{
+				std::exchange(state, nullptr)->Unref(RecyclingPool<CompletionState>::no_cache);
+			}
+		}
+
+		CompletionState* state = nullptr;
+	};
+
+	/*
+	* Handle of a WorkerPool::Submit task, a CompletionHandle whose slot also holds the task's result.
+	* Get() waits, rethrows the task's exception or moves the result out, once, like std::future::get.
+	* */
+	template <typename R>
+	class ResultHandle : public CompletionHandle
+	{
+	public:
+		//references are kept as pointers in the slot
+		using Stored = std::conditional_t<std::is_reference_v<R>, std::remove_reference_t<R>*, R>;
+
+		ResultHandle() noexcept = default;
+		explicit ResultHandle(CompletionState* state) noexcept : CompletionHandle(state) {}
+
+		R Get()
+		{
+			Wait();
+			if constexpr (std::is_reference_v<R>)
+				return *State()->template Result<Stored>();
+			else if constexpr (!std::is_void_v<R>)
+				return std::move(State()->template Result<Stored>());
+		}
+	};
+
+	/*
+	* Count of the tasks an object living outside the pool (TaskGroup, Strand...) waits for before it can be destroyed.
+	* An atomic decremented then notified won't do: the waiter can see the 0 and free the object before notify_all
+	* touches it. Here the last decrement, from 1 to 0, is made holding mx and Wait takes mx before it returns,
+	* so once Wait returned the tasks are done with the counter. The other decrements are a single compare exchange.
+	* */
+	class TaskCounter
+	{
+	public:
+		//returns the count before the increment
+		uint32_t Add(uint32_t count = 1) noexcept { return pending.fetch_add(count, std::memory_order_acq_rel); }
+
+		//returns true to the task which brought the count to 0, the counter must not be touched after that
+		bool Done() noexcept
+		{
+			auto p = pending.load(std::memory_order_relaxed);
+			while (p > 1)
+			{
+				if (pending.compare_exchange_weak(p, p - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+					return false;
+			}
+			std::unique_lock lk(mx);
+			if (pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+				return false;
+			zero_cv.notify_all();
+			return true;
+		}
+
+		[[nodiscard]] bool IsZero() const noexcept { return pending.load(std::memory_order_acquire) == 0; }
+
+		//blocks until the count is 0, also to be called after polling IsZero before the owner goes away
+		void Wait() noexcept
+		{
+			std::unique_lock lk(mx);
+			zero_cv.wait(lk, [this] { return IsZero(); });
+		}
+
+	private:
+		std::atomic<uint32_t> pending{ 0 };
+		std::mutex mx;
+		std::condition_variable zero_cv;
+	};
+}
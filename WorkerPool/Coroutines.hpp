@@ -0,0 +1,376 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "WorkerPool.hpp"
+
+namespace ms
+{
+	template <typename T = void>
+	class task;
+
+	namespace detail
+	{
+		//resumes whoever awaited the task once it is over, by symmetric transfer so the stack does not grow
+		struct TaskPromiseBase
+		{
+			struct FinalAwaiter
+			{
+				bool await_ready() const noexcept { return false; }
+
+				template <typename Promise>
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> finished) noexcept
+				{
+					return finished.promise().continuation;
+				}
+
+				void await_resume() const noexcept {}
+			};
+
+			std::suspend_always initial_suspend() const noexcept { return {}; }
+			FinalAwaiter final_suspend() const noexcept { return {}; }
+			void unhandled_exception() noexcept { error = std::current_exception(); }
+
+			void RethrowIfFailed() const
+			{
+				if (error)
+					std::rethrow_exception(error);
+			}
+
+			std::coroutine_handle<> continuation = std::noop_coroutine();
+			std::exception_ptr error;
+		};
+
+		template <typename T>
+		struct TaskPromise : TaskPromiseBase
+		{
+			task<T> get_return_object() noexcept;
+
+			template <typename U = T, typename = std::enable_if_t<std::is_convertible_v<U&&, T>>>
+			void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+
+			T Result()
+			{
+				RethrowIfFailed();
+				return std::move(*value);
+			}
+
+			std::optional<T> value;
+		};
+
+		template <>
+		struct TaskPromise<void> : TaskPromiseBase
+		{
+			task<void> get_return_object() noexcept;
+
+			void return_void() const noexcept {}
+
+			void Result() const { RethrowIfFailed(); }
+		};
+
+		/*
+		* Coroutine which starts right away and frees its own frame when it is over, nobody awaits it.
+		* Used to run the children of WhenAll/WhenAny and SyncWait, its body must not throw.
+		* */
+		struct Detached
+		{
+			struct promise_type
+			{
+				Detached get_return_object() const noexcept { return {}; }
+				std::suspend_never initial_suspend() const noexcept { return {}; }
+				std::suspend_never final_suspend() const noexcept { return {}; }
+				void return_void() const noexcept {}
+				void unhandled_exception() const noexcept { std::terminate(); }
+			};
+		};
+
+		struct TaskAccess;
+	}
+
+	/*
+	* Lazy coroutine returning a T, written co_return value; (co_return; for task<void>).
+	* Nothing runs until the task is awaited, it then runs on the awaiting thread up to its first suspension point
+	* (co_await pool.Schedule() moves it onto a worker) and when it finishes it resumes the awaiting coroutine on the
+	* thread it finished on. No thread ever blocks in between, only SyncWait does.
+	* An exception escaping the coroutine is rethrown by co_await. Lower case to tell it apart from ms::Task, the pool's callable.
+	*
+	* Example:
+	*	ms::task<int> Answer(ms::WorkerPool& pool) { co_await pool.Schedule(); co_return 42; }
+	*	int answer = ms::SyncWait(Answer(pool));
+	* */
+	template <typename T>
+	class [[nodiscard]] task
+	{
+	public:
+		using promise_type = detail::TaskPromise<T>;
+
+		task() noexcept = default;
+		task(const task&) = delete;
+		task& operator = (const task&) = delete;
+		task(task&& other) noexcept : coroutine(std::exchange(other.coroutine, nullptr)) {}
+		task& operator = (task&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Destroy();
+				coroutine = std::exchange(other.coroutine, nullptr);
+			}
+			return *this;
+		}
+		~task() { Destroy(); }
+
+		[[nodiscard]] bool IsReady() const noexcept { return !coroutine || coroutine.done(); }
+
+		auto operator co_await() && noexcept { return Awaiter{ coroutine }; }
+		auto operator co_await() & noexcept { return Awaiter{ coroutine }; }
+
+	private:
+		friend promise_type;
+		friend struct detail::TaskAccess;
+
+		explicit task(std::coroutine_handle<promise_type> coroutine) noexcept : coroutine(coroutine) {}
+
+		//starts the task (or waits for it) without taking the result
+		struct ReadyAwaiter
+		{
+			std::coroutine_handle<promise_type> coroutine;
+
+			bool await_ready() const noexcept { return !coroutine || coroutine.done(); }
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+			{
+				coroutine.promise().continuation = awaiting;
+				return coroutine;
+			}
+			void await_resume() const noexcept {}
+		};
+
+		struct Awaiter : ReadyAwaiter
+		{
+			decltype(auto) await_resume()
+			{
+				if (!this->coroutine)
+					throw std::logic_error("awaiting an empty task");
+				return this->coroutine.promise().Result();
+			}
+		};
+
+		void Destroy() noexcept
+		{
+			if (coroutine)
+				coroutine.destroy();
+			coroutine = nullptr;
+		}
+
+		std::coroutine_handle<promise_type> coroutine;
+	};
+
+	namespace detail
+	{
+		template <typename T>
+		task<T> TaskPromise<T>::get_return_object() noexcept { return task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this)); }
+
+		inline task<void> TaskPromise<void>::get_return_object() noexcept { return task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this)); }
+
+		struct TaskAccess
+		{
+			template <typename T>
+			static auto Ready(task<T>& t) noexcept { return typename task<T>::ReadyAwaiter{ t.coroutine }; }
+
+			//only once the task is ready
+			template <typename T>
+			static decltype(auto) Result(task<T>& t) { return t.coroutine.promise().Result(); }
+		};
+
+		/*
+		* Shared by the children of a WhenAll. The count starts one above the number of children so the awaiting coroutine
+		* cannot be resumed before await_suspend has started all of them, whoever brings it to zero resumes it.
+		* */
+		struct AllCounter
+		{
+			std::atomic<size_t> count;
+			std::coroutine_handle<> awaiting;
+
+			bool Arrive() noexcept { return count.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+		};
+
+		template <typename T>
+		Detached RunAllChild(task<T>& child, AllCounter& counter)
+		{
+			co_await TaskAccess::Ready(child);
+			//nothing of this frame is touched once the awaiting coroutine runs, it owns child and counter
+			if (counter.Arrive())
+				counter.awaiting.resume();
+		}
+
+		template <typename T>
+		struct AllAwaiter
+		{
+			explicit AllAwaiter(std::vector<task<T>>& children) noexcept : children(children), counter{ children.size() + 1, nullptr } {}
+
+			std::vector<task<T>>& children;
+			AllCounter counter;
+
+			bool await_ready() const noexcept { return children.empty(); }
+			bool await_suspend(std::coroutine_handle<> awaiting) noexcept
+			{
+				counter.awaiting = awaiting;
+				for (auto& child : children)
+				{
+					RunAllChild(child, counter);
+				}
+				//all the children finished inline, carry on without suspending
+				return !counter.Arrive();
+			}
+			void await_resume() const noexcept {}
+		};
+
+		/*
+		* WhenAny returns as soon as one child is over while the others keep running, so the children live here and not
+		* in the WhenAny frame. The last child to finish frees it.
+		* */
+		template <typename T>
+		struct AnyState
+		{
+			explicit AnyState(std::vector<task<T>>&& children) : children(std::move(children)) {}
+
+			std::vector<task<T>> children;
+			std::atomic<bool> decided{ false };
+			size_t winner = 0;
+			std::coroutine_handle<> awaiting;
+		};
+
+		template <typename T>
+		Detached RunAnyChild(std::shared_ptr<AnyState<T>> state, size_t index)
+		{
+			co_await TaskAccess::Ready(state->children[index]);
+			if (!state->decided.exchange(true, std::memory_order_acq_rel))
+			{
+				state->winner = index;
+				state->awaiting.resume();
+			}
+		}
+
+		template <typename T>
+		struct AnyAwaiter
+		{
+			//borrowed from WhenAny, GCC 12 releases a copy held by the co_await operand twice
+			const std::shared_ptr<AnyState<T>>& state;
+
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> awaiting) noexcept
+			{
+				//the awaiting coroutine may be resumed, and this awaiter destroyed, by the first child to finish
+				auto shared = state;
+				shared->awaiting = awaiting;
+				for (size_t i = 0; i < shared->children.size(); i++)
+				{
+					RunAnyChild(shared, i);
+				}
+			}
+			void await_resume() const noexcept {}
+		};
+
+		//the waiter may return as soon as it sees ready, so it is only ever read and written under the lock
+		struct SyncEvent
+		{
+			void Set()
+			{
+				std::lock_guard lk(mx);
+				ready = true;
+				cv.notify_one();
+			}
+
+			void Wait()
+			{
+				std::unique_lock lk(mx);
+				cv.wait(lk, [this] { return ready; });
+			}
+
+			std::mutex mx;
+			std::condition_variable cv;
+			bool ready = false;
+		};
+
+		template <typename T>
+		Detached SetWhenReady(task<T>& t, SyncEvent& event)
+		{
+			co_await TaskAccess::Ready(t);
+			event.Set();
+		}
+	}
+
+	/*
+	* Runs all the tasks concurrently (each one up to its first suspension point on the calling thread) and completes once all of them
+	* are over, the results are in the order of the tasks. If some of them threw, the first one's exception (in that order) is rethrown.
+	* */
+	template <typename T>
+	task<std::vector<T>> WhenAll(std::vector<task<T>> tasks)
+	{
+		co_await detail::AllAwaiter<T>(tasks);
+		std::vector<T> results;
+		results.reserve(tasks.size());
+		for (auto& t : tasks)
+		{
+			results.push_back(detail::TaskAccess::Result(t));
+		}
+		co_return results;
+	}
+
+	inline task<void> WhenAll(std::vector<task<void>> tasks)
+	{
+		co_await detail::AllAwaiter<void>(tasks);
+		for (auto& t : tasks)
+		{
+			detail::TaskAccess::Result(t);
+		}
+	}
+
+	/*
+	* Runs all the tasks concurrently and completes as soon as the first one is over, with its index and result
+	* (its exception is rethrown if it threw). The other tasks keep running to their end, their results are dropped.
+	* Throws std::invalid_argument for an empty vector.
+	* */
+	template <typename T>
+	task<std::pair<size_t, T>> WhenAny(std::vector<task<T>> tasks)
+	{
+		if (tasks.empty())
+			throw std::invalid_argument("WhenAny needs at least one task");
+		auto state = std::make_shared<detail::AnyState<T>>(std::move(tasks));
+		co_await detail::AnyAwaiter<T>{ state };
+		auto winner = state->winner;
+		co_return std::pair<size_t, T>(winner, detail::TaskAccess::Result(state->children[winner]));
+	}
+
+	inline task<size_t> WhenAny(std::vector<task<void>> tasks)
+	{
+		if (tasks.empty())
+			throw std::invalid_argument("WhenAny needs at least one task");
+		auto state = std::make_shared<detail::AnyState<void>>(std::move(tasks));
+		co_await detail::AnyAwaiter<void>{ state };
+		auto winner = state->winner;
+		detail::TaskAccess::Result(state->children[winner]);
+		co_return winner;
+	}
+
+	/*
+	* Blocks the calling thread until the task is over and returns its result (or rethrows its exception).
+	* The bridge from plain code into coroutines, never call it from a worker of the pool the task waits on.
+	* */
+	template <typename T>
+	T SyncWait(task<T> t)
+	{
+		detail::SyncEvent event;
+		detail::SetWhenReady(t, event);
+		event.Wait();
+		return detail::TaskAccess::Result(t);
+	}
+}
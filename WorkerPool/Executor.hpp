@@ -0,0 +1,261 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include "TaskQueue.hpp"
+#include "WorkerPool.hpp"
+
+namespace ms
+{
+	/*
+	* Process wide pool, started on first use with hardware_concurrency() workers and stopped at exit.
+	* Libraries sharing one process should run on it (directly or through an ExecutorView) rather than each starting
+	* a pool of their own, a few pools of hardware_concurrency() threads each are enough to oversubscribe the machine.
+	* */
+	inline WorkerPool& DefaultPool()
+	{
+		static WorkerPool pool;
+		return pool;
+	}
+
+	struct ExecutorOptions
+	{
+		//tasks of the view running at the same time, 0 for the pool's capacity
+		unsigned int max_concurrency = 0;
+		//tasks of the view waiting for a turn, 0 keeps the queue unbounded. Post waits for room, TryPost fails
+		size_t queue_capacity = 0;
+	};
+
+	//counters of an ExecutorView, see ExecutorView::Stats
+	struct ExecutorStats
+	{
+		uint64_t submitted = 0;
+		uint64_t completed = 0; //including the failed ones
+		uint64_t failed = 0; //threw
+		uint64_t rejected = 0; //TryPost on a full queue
+		size_t queued = 0;
+		size_t running = 0;
+		size_t peak_queued = 0;
+		size_t peak_running = 0;
+		unsigned int max_concurrency = 0;
+	};
+
+	/*
+	* Lightweight view of a shared pool which caps how many of its tasks run at once, so one component can't take
+	* every worker of the process wide pool. A view owns no thread: its tasks wait in its own queue and at most
+	* max_concurrency pool tasks drain that queue, each running up to drain_batch of them before it goes back
+	* to the end of the pool's shared queue (see WorkerPool::ScheduleDrain).
+	* Views cost a queue and a mutex, a process can have as many as it has components.
+	*
+	* Exceptions thrown by the tasks are swallowed and counted as failed, as with WorkerPool::Post.
+	* The view must outlive its tasks, the destructor waits for them. The pool must outlive the view.
+	* */
+	class ExecutorView
+	{
+	public:
+		static constexpr size_t drain_batch = 32;
+
+		explicit ExecutorView(const ExecutorOptions& options = {}) : ExecutorView(DefaultPool(), options) {}
+
+		ExecutorView(WorkerPool& pool, const ExecutorOptions& options = {}) : pool(pool),
+			max_concurrency(std::max(1u, options.max_concurrency ? options.max_concurrency : pool.Capacity())),
+			queue_capacity(options.queue_capacity), queue(options.queue_capacity ? options.queue_capacity : 64)
+		{
+		}
+		ExecutorView(const ExecutorView&) = delete;
+		ExecutorView& operator = (const ExecutorView&) = delete;
+
+		~ExecutorView()
+		{
+			Wait();
+		}
+
+		[[nodiscard]] WorkerPool& Pool() const noexcept { return pool; }
+
+		[[nodiscard]] unsigned int MaxConcurrency() const noexcept { return max_concurrency; }
+
+		/*
+		* Queues the task behind the view's waiting ones, it starts as soon as the view is under its quota.
+		* With a bounded queue which is full a thread outside the pool waits for room, one of the pool's workers runs
+		* other queued pool tasks meanwhile (see WorkerPool::HelpWhile). One of the view's own tasks never waits:
+		* it may be the only one draining the queue, so its task goes past the capacity instead.
+		* If the pool is stopping the view's tasks are run on the calling thread.
+		* */
+		void Post(Task&& task)
+		{
+			std::unique_lock lk(mx);
+			if (queue_capacity && queue.Size() >= queue_capacity && running_view != this)
+			{
+				if (pool.CurrentWorkerIndex() >= 0)
+				{
+					lk.unlock();
+					pool.HelpWhile([this] { std::scoped_lock guard(mx); return queue.Size() >= queue_capacity; });
+					lk.lock();
+				}
+				room_cv.wait(lk, [this] { return queue.Size() < queue_capacity; });
+			}
+			Push(std::move(task), lk);
+		}
+
+		//Post which never waits, returns false and leaves the task in task if the queue is full
+		[[nodiscard]] bool TryPost(Task&& task)
+		{
+			std::unique_lock lk(mx);
+			if (queue_capacity && queue.Size() >= queue_capacity)
+			{
+				rejected++;
+				return false;
+			}
+			Push(std::move(task), lk);
+			return true;
+		}
+
+		/*
+		* WorkerPool::Submit through the view's quota, the result goes to one of the pool's recycled completion slots.
+		* A task which throws is counted as failed and its exception is rethrown by Get().
+		* */
+		template <typename F, typename... Args, typename R = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>
+		[[nodiscard]] ResultHandle<R> Submit(F&& f, Args&&... args)
+		{
+			auto completion = pool.AcquireCompletion(1);
+			ResultHandle<R> handle(completion);
+			try
+			{
+				Post([this, completion, f = std::forward<F>(f), ...args = std::forward<Args>(args)]() mutable {
+					std::exception_ptr error;
+					try
+					{
+						WorkerPool::InvokeInto<R>(completion, f, args...);
+					}
+					catch (...)
+					{
+						error = std::current_exception();
+					}
+					completion->TaskFinished(error, pool.CurrentCacheIndex());
+					if (error)
+						std::rethrow_exception(error);
+				});
+			}
+			catch (...)
+			{
+				//the task's reference
+				completion->TaskFinished(std::current_exception(), pool.CurrentCacheIndex());
+				throw;
+			}
+			return handle;
+		}
+
+		[[nodiscard]] bool IsIdle() const
+		{
+			std::unique_lock lk(mx);
+			return running == 0 && queue.Empty();
+		}
+
+		//returns once every task posted so far is over, helps like Post when called from one of the pool's workers
+		void Wait()
+		{
+			if (pool.CurrentWorkerIndex() >= 0)
+				pool.HelpWhile([this] { return !IsIdle(); });
+			std::unique_lock lk(mx);
+			idle_cv.wait(lk, [this] { return running == 0 && queue.Empty(); });
+		}
+
+		[[nodiscard]] ExecutorStats Stats() const
+		{
+			std::unique_lock lk(mx);
+			ExecutorStats stats;
+			stats.submitted = submitted;
+			stats.completed = completed.load(std::memory_order_relaxed);
+			stats.failed = failed.load(std::memory_order_relaxed);
+			stats.rejected = rejected;
+			stats.queued = queue.Size();
+			stats.running = running;
+			stats.peak_queued = peak_queued;
+			stats.peak_running = peak_running;
+			stats.max_concurrency = max_concurrency;
+			return stats;
+		}
+
+	private:
+		//lk holds mx, it is released before a drainer is scheduled
+		void Push(Task&& task, std::unique_lock<std::mutex>& lk)
+		{
+			queue.Push(std::move(task));
+			submitted++;
+			peak_queued = std::max(peak_queued, queue.Size());
+			if (running >= max_concurrency)
+				return;
+			running++;
+			peak_running = std::max(peak_running, running);
+			lk.unlock();
+			Schedule();
+		}
+
+		void Schedule() noexcept
+		{
+			pool.ScheduleDrain(drain_batch, [this](size_t budget) { Drain(budget); });
+		}
+
+		//one of the view's running slots, gives it back once the queue is empty
+		void Drain(size_t budget) noexcept
+		{
+			auto outer = std::exchange(running_view, this);
+			for (size_t n = 0; n < budget; n++)
+			{
+				Task task;
+				{
+					std::unique_lock lk(mx);
+					if (queue.Empty())
+					{
+						if (--running == 0)
+							idle_cv.notify_all();
+						running_view = outer;
+						return;
+					}
+					task = queue.Pop();
+					if (queue_capacity)
+						room_cv.notify_one();
+				}
+
+				try
+				{
+					task();
+				}
+				catch (...)
+				{
+					failed.fetch_add(1, std::memory_order_relaxed);
+				}
+				task.Reset();
+				completed.fetch_add(1, std::memory_order_relaxed);
+			}
+			running_view = outer;
+			Schedule();
+		}
+
+		//the view whose task the thread is running, if any
+		static inline thread_local const ExecutorView* running_view = nullptr;
+
+		WorkerPool& pool;
+		const unsigned int max_concurrency;
+		const size_t queue_capacity;
+
+		mutable std::mutex mx;
+		std::condition_variable room_cv;
+		std::condition_variable idle_cv;
+		RingQueue<Task> queue;
+		size_t running = 0; //drainers scheduled or running
+		uint64_t submitted = 0;
+		uint64_t rejected = 0;
+		size_t peak_queued = 0;
+		size_t peak_running = 0;
+		std::atomic<uint64_t> completed{ 0 };
+		std::atomic<uint64_t> failed{ 0 };
+	};
+}
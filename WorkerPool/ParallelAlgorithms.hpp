@@ -0,0 +1,174 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <optional>
+#include <ranges>
+#include <type_traits>
+#include <vector>
+#include "WorkerPool.hpp"
+
+namespace ms
+{
+	namespace detail
+	{
+		//elements of [first, first + n) are addressed by offset, first is either an integer or a random access iterator
+		template <typename Index>
+		decltype(auto) ElementAt(Index first, size_t offset)
+		{
+			if constexpr (std::is_integral_v<Index>)
+				return static_cast<Index>(first + static_cast<Index>(offset));
+			else
+				return *(first + static_cast<std::iter_difference_t<Index>>(offset));
+		}
+
+		/*
+		* Adaptive range splitting shared by ParallelFor and ParallelReduce (auto partitioner, lazy binary splitting).
+		* The calling thread starts with the whole range. Every piece keeps handing its right half over to the pool while it is
+		* larger than the grain size and either the pool has not got a piece per worker yet or some worker is sitting idle.
+		* So a balanced loop on a busy pool ends up in about one piece per worker and an unbalanced one keeps splitting
+		* where the work is, down to the grain size.
+		* */
+		template <typename RunPiece>
+		class AdaptiveSplitter
+		{
+		public:
+			AdaptiveSplitter(WorkerPool& pool, size_t count, size_t grain_size, RunPiece run_piece)
+				: pool(pool), run_piece(std::move(run_piece)), count(count)
+			{
+				auto workers = std::max(pool.ThreadCount(), 1u);
+				this->grain_size = grain_size ? grain_size : std::max<size_t>(1, count / (workers * 8));
+				while ((size_t(1) << forced_depth) < workers) forced_depth++;
+			}
+
+			//runs the whole range, the calling thread takes part and returns once every element is done
+			void Run()
+			{
+				if (count == 0) return;
+				pieces.Add();
+				RunRange(0, count, 0);
+
+				//called from a task (nested loops), run the pool's tasks meanwhile rather than holding a worker
+				if (pool.CurrentWorkerIndex() >= 0)
+					pool.HelpWhile([this] { return !pieces.IsZero(); });
+				//the splitter lives on this thread's stack, the task running the last piece may still be in Done
+				pieces.Wait();
+				if (error)
+					std::rethrow_exception(error);
+			}
+
+		private:
+			void RunRange(size_t begin, size_t end, unsigned int depth) noexcept
+			{
+				while (end - begin > grain_size && (depth < forced_depth || pool.IsWorkersAvailable()))
+				{
+					auto middle = begin + (end - begin) / 2;
+					depth++;
+					pieces.Add();
+					try
+					{
+						pool.Fork([this, middle, end, depth] { RunRange(middle, end, depth); });
+					}
+					catch (...)
+					{
+						//the pool is stopping, keep the rest of the range on this thread
+						pieces.Done();
+						break;
+					}
+					end = middle;
+				}
+
+				try
+				{
+					run_piece(begin, end);
+				}
+				catch (...)
+				{
+					if (!failed.exchange(true, std::memory_order_relaxed))
+						error = std::current_exception();
+				}
+
+				pieces.Done();
+			}
+
+			WorkerPool& pool;
+			RunPiece run_piece;
+			size_t grain_size;
+			unsigned int forced_depth = 0;
+			size_t count;
+			TaskCounter pieces; //started and not finished yet
+			std::atomic<bool> failed{ false };
+			std::exception_ptr error;
+		};
+
+		//one slot per worker plus one for the calling thread, padded so that the slots never share a cache line
+		template <typename T>
+		struct alignas(64) PartialResult
+		{
+			std::optional<T> value;
+		};
+	}
+
+	/*
+	* Calls body(i) for every i in [first, last) on the pool, first/last are integers or random access iterators
+	* (with iterators body receives the element, like std::for_each). Returns when all the calls have finished,
+	* the first exception thrown by body is rethrown.
+	*
+	* grain_size - the smallest number of elements a task is allowed to work on, 0 picks one from the range size and the pool size.
+	* */
+	template <typename Index, typename Body>
+	void ParallelFor(WorkerPool& pool, Index first, Index last, Body&& body, size_t grain_size = 0)
+	{
+		auto count = static_cast<size_t>(last - first);
+		auto run_piece = [first, &body](size_t begin, size_t end) {
+			for (auto i = begin; i < end; i++)
+			{
+				body(detail::ElementAt(first, i));
+			}
+		};
+		detail::AdaptiveSplitter<decltype(run_piece)> splitter(pool, count, grain_size, std::move(run_piece));
+		splitter.Run();
+	}
+
+	/*
+	* Reduces [first, last) with op on the pool and returns op(init, partials...).
+	* Every task folds its piece locally and merges the result into the slot of the worker running it, the slots are
+	* cache line padded and combined by the calling thread at the end, so there is no shared counter on the hot path.
+	* Like std::reduce, op has to be associative and commutative and T must be constructible from an element.
+	* */
+	template <typename Iterator, typename T, typename Op>
+	[[nodiscard]] T ParallelReduce(WorkerPool& pool, Iterator first, Iterator last, T init, Op op, size_t grain_size = 0)
+	{
+		std::vector<detail::PartialResult<T>> partials(pool.Capacity() + 1);
+		auto run_piece = [first, &op, &pool, &partials](size_t begin, size_t end) {
+			T partial(detail::ElementAt(first, begin));
+			for (auto i = begin + 1; i < end; i++)
+			{
+				partial = op(std::move(partial), detail::ElementAt(first, i));
+			}
+
+			auto worker = pool.CurrentWorkerIndex();
+			auto& slot = partials[worker >= 0 ? static_cast<size_t>(worker) : partials.size() - 1].value;
+			if (slot)
+				slot = op(std::move(*slot), std::move(partial));
+			else
+				slot.emplace(std::move(partial));
+		};
+		detail::AdaptiveSplitter<decltype(run_piece)> splitter(pool, static_cast<size_t>(last - first), grain_size, std::move(run_piece));
+		splitter.Run();
+
+		for (auto& partial : partials)
+		{
+			if (partial.value)
+				init = op(std::move(init), std::move(*partial.value));
+		}
+		return init;
+	}
+
+	template <std::ranges::random_access_range Range, typename T, typename Op>
+	[[nodiscard]] T ParallelReduce(WorkerPool& pool, Range&& range, T init, Op op, size_t grain_size = 0)
+	{
+		return ParallelReduce(pool, std::ranges::begin(range), std::ranges::end(range), std::move(init), std::move(op), grain_size);
+	}
+}
@@ -0,0 +1,160 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace ms
+{
+	/*
+	* Free list for the objects the pool needs once per submission (task records, completion states).
+	* Objects are created on demand and never given back to the memory resource until the pool is destroyed,
+	* so once the pool is warmed up a submission does not allocate at all.
+	* They are carved out of slabs of slab_size objects, one allocation from the resource per slab: the warm up costs
+	* a fraction of the allocations and the objects handed out together sit next to each other.
+	*
+	* Every worker has its own cache which it uses without any locking. Threads outside the pool go through the shared list under a mutex.
+	* The caches exchange objects with the shared list in batches, as the objects submitted from outside usually end up released by the workers.
+	*
+	* With recycle false every object is allocated from the resource on Acquire and given back on Release, the baseline
+	* the allocation benchmark compares with. It also lets the address sanitizer see an object used after its release.
+	* */
+	template <typename T>
+	class RecyclingPool
+	{
+	public:
+		static constexpr size_t no_cache = static_cast<size_t>(-1);
+
+		static constexpr size_t slab_size = 64;
+
+		//resource has to be thread safe and outlive the pool, nullptr is the heap
+		explicit RecyclingPool(size_t cache_count, std::pmr::memory_resource* resource = nullptr, bool recycle = true)
+			: caches(recycle ? cache_count : 0), resource(resource ? resource : std::pmr::new_delete_resource()), recycle(recycle)
+		{
+			for (auto& cache : caches)
+				cache.items.reserve(cache_limit);
+		}
+		RecyclingPool(const RecyclingPool&) = delete;
+		RecyclingPool& operator = (const RecyclingPool&) = delete;
+
+		//all the acquired objects have to be released before this point
+		~RecyclingPool()
+		{
+			for (auto& cache : caches)
+				for (auto item : cache.items) item->~T();
+			for (auto item : shared) item->~T();
+			for (auto slab : slabs) resource->deallocate(slab, sizeof(T) * slab_size, alignof(T));
+		}
+
+		/*
+		* cache_index is the index of the calling worker or no_cache for any other thread
+		* */
+		T* Acquire(size_t cache_index)
+		{
+			if (!recycle)
+			{
+				auto item = static_cast<T*>(resource->allocate(sizeof(T), alignof(T)));
+				return ::new (static_cast<void*>(item)) T();
+			}
+
+			if (cache_index == no_cache)
+			{
+				std::unique_lock lk(shared_mx);
+				if (shared.empty())
+					return Carve(shared);
+				auto item = shared.back();
+				shared.pop_back();
+				return item;
+			}
+
+			auto& items = caches[cache_index].items;
+			if (items.empty())
+			{
+				std::unique_lock lk(shared_mx);
+				auto moved = std::min(batch_size, shared.size());
+				items.insert(items.end(), shared.end() - moved, shared.end());
+				shared.resize(shared.size() - moved);
+			}
+			if (items.empty())
+				return Carve(items);
+
+			auto item = items.back();
+			items.pop_back();
+			return item;
+		}
+
+		void Release(T* item, size_t cache_index)
+		{
+			if (!recycle)
+			{
+				item->~T();
+				resource->deallocate(item, sizeof(T), alignof(T));
+				return;
+			}
+
+			if (cache_index == no_cache)
+			{
+				std::unique_lock lk(shared_mx);
+				shared.push_back(item);
+				return;
+			}
+
+			auto& items = caches[cache_index].items;
+			items.push_back(item);
+			if (items.size() >= cache_limit)
+			{
+				std::unique_lock lk(shared_mx);
+				shared.insert(shared.end(), items.end() - batch_size, items.end());
+				items.resize(items.size() - batch_size);
+			}
+		}
+
+	private:
+		/*
+		* Allocates a slab, returns its first object and adds the others to spare (a worker's own cache, or the shared list
+		* with shared_mx held). Only the shared list moves objects between caches, so a worker's cache never gets over cache_limit.
+		* */
+		T* Carve(std::vector<T*>& spare)
+		{
+			spare.reserve(spare.size() + slab_size);
+			auto slab = static_cast<T*>(resource->allocate(sizeof(T) * slab_size, alignof(T)));
+			{
+				std::unique_lock lk(slabs_mx);
+				try
+				{
+					slabs.push_back(slab);
+				}
+				catch (...)
+				{
+					resource->deallocate(slab, sizeof(T) * slab_size, alignof(T));
+					throw;
+				}
+			}
+			for (size_t i = 0; i < slab_size; i++)
+				::new (static_cast<void*>(slab + i)) T();
+			for (size_t i = slab_size - 1; i > 0; i--)
+				spare.push_back(slab + i);
+			return slab;
+		}
+
+		static constexpr size_t cache_limit = 128;
+		static constexpr size_t batch_size = cache_limit / 2;
+
+		//each cache is touched by one worker only, keep them on separate cache lines
+		struct alignas(64) Cache
+		{
+			std::vector<T*> items;
+		};
+
+		std::vector<Cache> caches;
+		std::mutex shared_mx;
+		std::vector<T*> shared;
+		std::pmr::memory_resource* resource;
+		bool recycle;
+		std::mutex slabs_mx;
+		std::vector<T*> slabs;
+	};
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ms
+{
+	/*
+	* Plain copy of a LatencyHistogram (or the sum of several), safe to inspect at leisure.
+	* Bucket i counts the samples in [2^(i-1), 2^i) nanoseconds, so percentiles are reported as the upper bound of their bucket.
+	* */
+	struct HistogramSnapshot
+	{
+		static constexpr size_t bucket_count = 48;
+
+		uint64_t count = 0;
+		uint64_t total_ns = 0;
+		uint64_t max_ns = 0;
+		std::array<uint64_t, bucket_count> buckets{};
+
+		[[nodiscard]] std::chrono::nanoseconds Mean() const noexcept
+		{
+			return std::chrono::nanoseconds(count ? total_ns / count : 0);
+		}
+
+		[[nodiscard]] std::chrono::nanoseconds Max() const noexcept
+		{
+			return std::chrono::nanoseconds(max_ns);
+		}
+
+		//percentile in [0, 100]
+		[[nodiscard]] std::chrono::nanoseconds Percentile(double percentile) const noexcept
+		{
+			if (count == 0)
+				return std::chrono::nanoseconds(0);
+
+			auto rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(count - 1)) + 1;
+			uint64_t seen = 0;
+			for (size_t i = 0; i < bucket_count; i++)
+			{
+				seen += buckets[i];
+				if (seen >= rank)
+				{
+					auto upper_bound = i == 0 ? 0 : (uint64_t(1) << i) - 1;
+					return std::chrono::nanoseconds(upper_bound < max_ns ? upper_bound : max_ns);
+				}
+			}
+			return Max();
+		}
+
+		HistogramSnapshot& operator += (const HistogramSnapshot& other) noexcept
+		{
+			count += other.count;
+			total_ns += other.total_ns;
+			max_ns = max_ns > other.max_ns ? max_ns : other.max_ns;
+			for (size_t i = 0; i < bucket_count; i++)
+				buckets[i] += other.buckets[i];
+			return *this;
+		}
+	};
+
+	/*
+	* Log2 bucketed latency histogram. Meant to be owned by one worker (kept next to the worker's other data),
+	* so Record is a handful of uncontended relaxed atomic adds, and read by anyone through Snapshot.
+	* */
+	class LatencyHistogram
+	{
+	public:
+		void Record(std::chrono::nanoseconds duration) noexcept
+		{
+			auto ns = duration.count() > 0 ? static_cast<uint64_t>(duration.count()) : 0;
+			size_t bucket = 0;
+			for (auto v = ns; v != 0 && bucket < HistogramSnapshot::bucket_count - 1; v >>= 1)
+				bucket++;
+
+			buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+			total_ns.fetch_add(ns, std::memory_order_relaxed);
+			count.fetch_add(1, std::memory_order_relaxed);
+			auto current_max = max_ns.load(std::memory_order_relaxed);
+			while (ns > current_max && !max_ns.compare_exchange_weak(current_max, ns, std::memory_order_relaxed));
+		}
+
+		[[nodiscard]] HistogramSnapshot Snapshot() const noexcept
+		{
+			HistogramSnapshot snapshot;
+			snapshot.count = count.load(std::memory_order_relaxed);
+			snapshot.total_ns = total_ns.load(std::memory_order_relaxed);
+			snapshot.max_ns = max_ns.load(std::memory_order_relaxed);
+			for (size_t i = 0; i < HistogramSnapshot::bucket_count; i++)
+				snapshot.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+			return snapshot;
+		}
+
+	private:
+		std::array<std::atomic<uint64_t>, HistogramSnapshot::bucket_count> buckets{};
+		std::atomic<uint64_t> count{ 0 };
+		std::atomic<uint64_t> total_ns{ 0 };
+		std::atomic<uint64_t> max_ns{ 0 };
+	};
+
+	struct WorkerStats
+	{
+		bool running = false; //a thread lives in the slot
+		bool idle = false; //running, but not executing a task right now
+		uint64_t tasks_executed = 0;
+		//time spent executing tasks and waiting for them, over every thread which has lived in the slot
+		std::chrono::nanoseconds busy_time{ 0 };
+		std::chrono::nanoseconds idle_time{ 0 };
+	};
+
+	/*
+	* Snapshot returned by WorkerPool::Stats. The counters are read one after the other without stopping the workers,
+	* so on a busy pool the totals can be off by the few tasks which moved on while they were being collected.
+	* */
+	struct PoolStats
+	{
+		uint64_t tasks_submitted = 0;
+		uint64_t tasks_completed = 0;
+		uint64_t tasks_failed = 0; //completed, but threw
+		size_t queue_depth = 0; //submitted and not started yet, all the queues and lanes together
+		size_t tasks_running = 0;
+		unsigned int threads = 0;
+		//from submission to the start of the execution, and the execution itself including the completion callback
+		HistogramSnapshot queue_time;
+		HistogramSnapshot execution_time;
+		std::vector<WorkerStats> workers; //one per slot, see WorkerPool::Capacity
+	};
+}
@@ -0,0 +1,165 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "WorkerPool.hpp"
+
+namespace ms
+{
+	/*
+	* Serializes the tasks posted to it on a shared pool: they run one at a time, in the order they were posted,
+	* possibly on different workers. Meant for the streams (a connection, an account) which need ordering without
+	* a thread or a mutex of their own, a strand is only a queue and a counter so thousands of them cost nothing while idle.
+	*
+	* Posting pushes the task on a lock free intrusive queue (multiple producers, single consumer). The poster which takes
+	* the queue from empty to non empty schedules one pool task which runs the queued tasks, so a strand never has
+	* more than one task in the pool. It runs at most drain_batch of them before it goes back to the end of the pool's
+	* shared queue (see WorkerPool::ScheduleDrain), a busy strand does not hold a worker forever.
+	*
+	* Exceptions thrown by the tasks are swallowed, as with WorkerPool::Post. The strand must outlive its tasks,
+	* the destructor waits for them.
+	* */
+	class Strand
+	{
+	public:
+		static constexpr size_t drain_batch = 32;
+
+		explicit Strand(WorkerPool& pool) : pool(pool), tail(AcquireNode(Task{})), head(tail) {}
+		Strand(const Strand&) = delete;
+		Strand& operator = (const Strand&) = delete;
+
+		~Strand()
+		{
+			if (pool.CurrentWorkerIndex() >= 0)
+				pool.HelpWhile([this] { return !IsIdle(); });
+			//the drainer which ran the last task may still be in Done
+			pending.Wait();
+			ReleaseNode(tail);
+		}
+
+		/*
+		* Queues the task behind the ones already posted. If the pool is stopping the tasks of the strand are run
+		* on the calling thread instead, still in order.
+		* */
+		void Post(Task&& task)
+		{
+			auto node = AcquireNode(std::move(task));
+			head.exchange(node, std::memory_order_acq_rel)->next.store(node, std::memory_order_release);
+			if (pending.Add() == 0)
+				Schedule();
+		}
+
+		//true on the thread running one of this strand's tasks
+		[[nodiscard]] bool RunningInThisThread() const noexcept { return running_strand == this; }
+
+		[[nodiscard]] bool IsIdle() const noexcept { return pending.IsZero(); }
+
+	private:
+		struct Node
+		{
+			Task task;
+			std::atomic<Node*> next{ nullptr };
+		};
+
+		//recycled nodes of the calling thread, nodes move freely between strands and threads
+		struct NodeCache
+		{
+			static constexpr size_t limit = 64;
+
+			~NodeCache()
+			{
+				for (auto node : nodes) delete node;
+			}
+
+			std::vector<Node*> nodes;
+		};
+
+		static Node* AcquireNode(Task&& task)
+		{
+			auto& nodes = node_cache.nodes;
+			Node* node = nullptr;
+			if (nodes.empty())
+			{
+				node = new Node();
+			}
+			else
+			{
+				node = nodes.back();
+				nodes.pop_back();
+			}
+			node->task = std::move(task);
+			return node;
+		}
+
+		static void ReleaseNode(Node* node) noexcept
+		{
+			node->task.Reset();
+			node->next.store(nullptr, std::memory_order_relaxed);
+			auto& nodes = node_cache.nodes;
+			if (nodes.size() < NodeCache::limit)
+			{
+				try
+				{
+					nodes.push_back(node);
+					return;
+				}
+				catch (...)
+				{
+
+				}
+			}
+			delete node;
+		}
+
+		void Schedule() noexcept
+		{
+			pool.ScheduleDrain(drain_batch, [this](size_t budget) { Drain(budget); });
+		}
+
+		/*
+		* Only one thread at a time gets here. tail is the node of the last task run (its task already moved out),
+		* the next one is the oldest queued. pending counts the queued tasks, so a missing link is a poster between
+		* its exchange and its store, about to show up.
+		* */
+		void Drain(size_t budget) noexcept
+		{
+			auto outer = std::exchange(running_strand, this);
+			for (size_t n = 0; n < budget; n++)
+			{
+				Node* next = nullptr;
+				while (!(next = tail->next.load(std::memory_order_acquire)))
+					std::this_thread::yield();
+
+				auto task = std::move(next->task);
+				ReleaseNode(std::exchange(tail, next));
+				try
+				{
+					task();
+				}
+				catch (...)
+				{
+
+				}
+				task.Reset();
+
+				if (pending.Done())
+				{
+					running_strand = outer;
+					return;
+				}
+			}
+			running_strand = outer;
+			Schedule();
+		}
+
+		static inline thread_local NodeCache node_cache;
+		static inline thread_local const Strand* running_strand = nullptr;
+
+		WorkerPool& pool;
+		Node* tail; //consumer side
+		std::atomic<Node*> head; //producer side, the last node queued
+		TaskCounter pending; //tasks posted and not run yet
+	};
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace ms
+{
+	/*
+	* Move only replacement for std::function<void()> used for everything the pool executes.
+	* Callables up to inline_size bytes (which covers lambdas capturing a handful of iterators, pointers or a shared_ptr)
+	* are stored inside the object itself, so creating, moving and running a Task does not touch the heap.
+	* Bigger callables, over aligned ones and the ones that can throw while being moved fall back to a heap allocation.
+	* Since it is never copied, move only captures like std::unique_ptr or a std::vector buffer are accepted as well.
+	* */
+	class Task
+	{
+	public:
+		static constexpr size_t inline_size = 64 - sizeof(void*); //whole Task is one cache line
+		static constexpr size_t inline_alignment = alignof(void*);
+
+		template <typename F>
+		static constexpr bool is_stored_inline = sizeof(F) <= inline_size && alignof(F) <= inline_alignment && std::is_nothrow_move_constructible_v<F>;
+
+		Task() noexcept = default;
+		Task(std::nullptr_t) noexcept {}
+
+		template <typename F, typename D = std::decay_t<F>,
+			typename = std::enable_if_t<!std::is_same_v<D, Task> && std::is_invocable_r_v<void, D&>>>
+		Task(F&& callable)
+		{
+			//an empty std::function or a null function pointer gives an empty Task
+			if constexpr (requires(const D& d) { d == nullptr; })
+			{
+				if (callable == nullptr) return;
+			}
+
+			if constexpr (is_stored_inline<D>)
+			{
+				::new (static_cast<void*>(storage)) D(std::forward<F>(callable));
+			}
+			else
+			{
+				*reinterpret_cast<D**>(storage) = new D(std::forward<F>(callable));
+			}
+			ops = &ops_for<D>;
+		}
+
+		Task(Task&& other) noexcept
+		{
+			MoveFrom(other);
+		}
+
+		Task& operator = (Task&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Reset();
+				MoveFrom(other);
+			}
+			return *this;
+		}
+
+		Task(const Task&) = delete;
+		Task& operator = (const Task&) = delete;
+
+		~Task()
+		{
+			Reset();
+		}
+
+		void operator()()
+		{
+			ops->invoke(storage);
+		}
+
+		explicit operator bool() const noexcept { return ops != nullptr; }
+
+		[[nodiscard]] bool IsStoredInline() const noexcept { return ops != nullptr && ops->is_inline; }
+
+		void Reset() noexcept
+		{
+			if (ops)
+			{
+				ops->destroy(storage);
+				ops = nullptr;
+			}
+		}
+
+	private:
+		struct Ops
+		{
+			void (*invoke)(void* storage);
+			void (*relocate)(void* destination, void* source) noexcept; //move construct into destination and destroy the source
+			void (*destroy)(void* storage) noexcept;
+			bool is_inline;
+		};
+
+		template <typename D>
+		static constexpr Ops MakeOps()
+		{
+			if constexpr (is_stored_inline<D>)
+			{
+				return Ops{
+					[](void* s) { (*std::launder(static_cast<D*>(s)))(); },
+					[](void* d, void* s) noexcept {
+						auto source = std::launder(static_cast<D*>(s));
+						::new (d) D(std::move(*source));
+						source->~D();
+					},
+					[](void* s) noexcept { std::launder(static_cast<D*>(s))->~D(); },
+					true
+				};
+			}
+			else
+			{
+				return Ops{
+					[](void* s) { (**static_cast<D**>(s))(); },
+					[](void* d, void* s) noexcept { *static_cast<D**>(d) = *static_cast<D**>(s); },
+					[](void* s) noexcept { delete *static_cast<D**>(s); },
+					false
+				};
+			}
+		}
+
+		template <typename D>
+		static constexpr Ops ops_for = MakeOps<D>();
+
+		void MoveFrom(Task& other) noexcept
+		{
+			if (other.ops)
+			{
+				other.ops->relocate(storage, other.storage);
+				ops = std::exchange(other.ops, nullptr);
+			}
+		}
+
+		const Ops* ops = nullptr;
+		alignas(inline_alignment) unsigned char storage[inline_size];
+	};
+}
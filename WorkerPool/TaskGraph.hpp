@@ -0,0 +1,254 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "WorkerPool.hpp"
+
+namespace ms
+{
+	/*
+	* Dependency graph of tasks run on a WorkerPool.
+	* Nodes are added with AddNode and ordered with AddEdge(before, after). Run posts the nodes without predecessors and returns,
+	* every node then decrements the pending counters of its successors and the ones reaching zero are scheduled right away,
+	* so no thread ever blocks on a dependency. Wait blocks until the whole run is over.
+	*
+	* The graph is reusable: running it again only resets the counters, nothing is allocated once the pool is warmed up.
+	* The first exception thrown by a node is rethrown by Wait, the nodes which have not started by then are skipped.
+	* The graph must stay alive and unchanged until the run is over.
+	* */
+	class TaskGraph
+	{
+	public:
+		using NodeId = size_t;
+
+		TaskGraph() = default;
+		TaskGraph(const TaskGraph&) = delete;
+		TaskGraph& operator = (const TaskGraph&) = delete;
+
+		~TaskGraph()
+		{
+			//a run still in flight references the graph, and the node finishing the last one may still be in Finish
+			Wait(std::nothrow);
+		}
+
+		NodeId AddNode(Task&& work)
+		{
+			ThrowIfRunning();
+			nodes.emplace_back(std::move(work));
+			validated = false;
+			return nodes.size() - 1;
+		}
+
+		//'after' starts only once 'before' has finished
+		void AddEdge(NodeId before, NodeId after)
+		{
+			ThrowIfRunning();
+			if (before >= nodes.size() || after >= nodes.size())
+				throw std::out_of_range("TaskGraph node id out of range");
+			nodes[before].successors.push_back(after);
+			nodes[after].predecessor_count++;
+			validated = false;
+		}
+
+		[[nodiscard]] size_t Size() const noexcept { return nodes.size(); }
+
+		/*
+		* Schedules the graph on the pool and returns without waiting.
+		* when_done, if given, runs on the thread which finishes the last node, unless a node threw.
+		* Throws std::logic_error if the graph is already running or has a cycle.
+		* */
+		void Run(WorkerPool& pool, Task&& when_done = Task{})
+		{
+			ThrowIfRunning();
+			Validate();
+
+			this->pool = &pool;
+			this->when_done = std::move(when_done);
+			failed.store(false, std::memory_order_relaxed);
+			error = nullptr;
+			for (auto& node : nodes)
+			{
+				node.pending.store(node.predecessor_count, std::memory_order_relaxed);
+			}
+			remaining.store(nodes.size(), std::memory_order_relaxed);
+			running.Add();
+
+			if (nodes.empty())
+			{
+				Finish();
+				return;
+			}
+
+			for (NodeId id = 0; id < nodes.size(); id++)
+			{
+				if (nodes[id].predecessor_count != 0)
+					continue;
+				try
+				{
+					Schedule(id);
+				}
+				catch (...)
+				{
+					//the pool is stopping, the graph still has to finish for Wait to return
+					Execute(id);
+				}
+			}
+		}
+
+		[[nodiscard]] bool IsDone() const noexcept { return running.IsZero(); }
+
+		//blocks until the run is over, rethrows the first exception thrown by a node
+		void Wait()
+		{
+			Wait(std::nothrow);
+			if (error)
+				std::rethrow_exception(error);
+		}
+
+	private:
+		struct Node
+		{
+			explicit Node(Task&& work) : work(std::move(work)) {}
+			//only moved while the graph is being built, never while running
+			Node(Node&& other) noexcept : work(std::move(other.work)), successors(std::move(other.successors)), predecessor_count(other.predecessor_count) {}
+
+			Task work;
+			std::vector<NodeId> successors;
+			uint32_t predecessor_count = 0;
+			std::atomic<uint32_t> pending{ 0 };
+		};
+
+		void Wait(std::nothrow_t) noexcept
+		{
+			//waiting from a node or any other task, keep the worker busy with the pool's tasks
+			if (pool && pool->CurrentWorkerIndex() >= 0)
+				pool->HelpWhile([this] { return !IsDone(); });
+			running.Wait();
+		}
+
+		void ThrowIfRunning() const
+		{
+			if (!IsDone())
+				throw std::logic_error("TaskGraph is running");
+		}
+
+		//Kahn's algorithm, only after the graph was changed
+		void Validate()
+		{
+			if (validated)
+				return;
+
+			std::vector<uint32_t> in_degree(nodes.size());
+			std::vector<NodeId> ready;
+			for (NodeId id = 0; id < nodes.size(); id++)
+			{
+				in_degree[id] = nodes[id].predecessor_count;
+				if (in_degree[id] == 0)
+					ready.push_back(id);
+			}
+			size_t visited = 0;
+			while (!ready.empty())
+			{
+				auto id = ready.back();
+				ready.pop_back();
+				visited++;
+				for (auto successor : nodes[id].successors)
+				{
+					if (--in_degree[successor] == 0)
+						ready.push_back(successor);
+				}
+			}
+			if (visited != nodes.size())
+				throw std::logic_error("TaskGraph has a cycle");
+			validated = true;
+		}
+
+		void Schedule(NodeId id)
+		{
+			pool->Post([this, id] { Execute(id); });
+		}
+
+		/*
+		* Runs the node and releases its successors. One successor which became ready is run right here instead of going
+		* through the queue, the others are posted.
+		* */
+		void Execute(NodeId id) noexcept
+		{
+			while (id != no_node)
+			{
+				auto& node = nodes[id];
+				if (!failed.load(std::memory_order_relaxed))
+				{
+					try
+					{
+						node.work();
+					}
+					catch (...)
+					{
+						if (!failed.exchange(true, std::memory_order_relaxed))
+							error = std::current_exception();
+					}
+				}
+
+				NodeId next = no_node;
+				for (auto successor : node.successors)
+				{
+					if (nodes[successor].pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+						continue;
+					if (next == no_node)
+					{
+						next = successor;
+						continue;
+					}
+					try
+					{
+						Schedule(successor);
+					}
+					catch (...)
+					{
+						//the pool is stopping, run it on this thread
+						Execute(successor);
+					}
+				}
+
+				if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					Finish();
+				id = next;
+			}
+		}
+
+		void Finish() noexcept
+		{
+			auto done = std::move(when_done);
+			if (done && !failed.load(std::memory_order_acquire))
+			{
+				try
+				{
+					done();
+				}
+				catch (...)
+				{
+
+				}
+			}
+			done.Reset();
+			running.Done();
+		}
+
+		static constexpr NodeId no_node = ~NodeId(0);
+
+		std::vector<Node> nodes;
+		bool validated = true;
+		WorkerPool* pool = nullptr;
+		Task when_done;
+		std::atomic<size_t> remaining{ 0 };
+		TaskCounter running; //1 while a run is in flight
+		std::atomic<bool> failed{ false };
+		std::exception_ptr error;
+	};
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <new>
+#include <utility>
+#include "WorkerPool.hpp"
+
+namespace ms
+{
+	/*
+	* Fork-join scope: Run forks a task on the pool, Wait joins all of them.
+	* Waiting from one of the pool's workers runs other queued tasks meanwhile (see WorkerPool::HelpWhile), so recursive
+	* divide and conquer (parallel quicksort, tree reductions) can nest groups to any depth on any pool size without
+	* running out of workers. Waiting from any other thread blocks.
+	*
+	* The first exception thrown by a task is rethrown by Wait, the group can be reused afterwards.
+	* The group must outlive its tasks, the destructor waits for them.
+	* */
+	class TaskGroup
+	{
+	public:
+		explicit TaskGroup(WorkerPool& pool) : pool(pool) {}
+		TaskGroup(const TaskGroup&) = delete;
+		TaskGroup& operator = (const TaskGroup&) = delete;
+
+		~TaskGroup()
+		{
+			Wait(std::nothrow);
+		}
+
+		//queued with WorkerPool::Fork, throws like Post if the pool is stopping and the task is not part of the group then
+		template <typename F>
+		void Run(F&& work)
+		{
+			pending.Add();
+			try
+			{
+				pool.Fork([this, work = std::forward<F>(work)]() mutable { Execute(work); });
+			}
+			catch (...)
+			{
+				pending.Done();
+				throw;
+			}
+		}
+
+		[[nodiscard]] bool IsDone() const noexcept { return pending.IsZero(); }
+
+		//returns once every task run so far is over, rethrows the first exception thrown by one of them
+		void Wait()
+		{
+			Wait(std::nothrow);
+			if (failed.load(std::memory_order_relaxed))
+			{
+				auto e = std::exchange(error, nullptr);
+				failed.store(false, std::memory_order_relaxed);
+				std::rethrow_exception(e);
+			}
+		}
+
+	private:
+		void Wait(std::nothrow_t) noexcept
+		{
+			if (pool.CurrentWorkerIndex() >= 0)
+				pool.HelpWhile([this] { return !IsDone(); });
+			//after the helping too, the last task may still be in Done
+			pending.Wait();
+		}
+
+		template <typename F>
+		void Execute(F& work) noexcept
+		{
+			try
+			{
+				work();
+			}
+			catch (...)
+			{
+				if (!failed.exchange(true, std::memory_order_relaxed))
+					error = std::current_exception();
+			}
+			pending.Done();
+		}
+
+		WorkerPool& pool;
+		TaskCounter pending;
+		std::atomic<bool> failed{ false };
+		std::exception_ptr error;
+	};
+}
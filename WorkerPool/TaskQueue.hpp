@@ -0,0 +1,180 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace ms
+{
+	/*
+	* Unbounded FIFO on top of a power of two circular buffer. Not thread safe, the pool guards it with tq_mx.
+	* Unlike std::queue (std::deque underneath) it does not allocate and free a block every few hundred elements
+	* while tasks flow through it, it only grows when it is full and keeps that capacity afterwards.
+	* */
+	template <typename T>
+	class RingQueue
+	{
+	public:
+		explicit RingQueue(size_t initial_capacity = 1024)
+		{
+			Reserve(initial_capacity);
+		}
+		RingQueue(const RingQueue&) = delete;
+		RingQueue& operator = (const RingQueue&) = delete;
+
+		void Push(T item)
+		{
+			if (count == capacity)
+				Reserve(capacity * 2);
+			slots[(head + count) & (capacity - 1)] = std::move(item);
+			count++;
+		}
+
+		//queue must not be empty
+		T Pop()
+		{
+			T item = std::move(slots[head]);
+			head = (head + 1) & (capacity - 1);
+			count--;
+			return item;
+		}
+
+		//makes sure that 'expected' elements fit without growing again
+		void Reserve(size_t expected)
+		{
+			if (expected <= capacity) return;
+			size_t new_capacity = capacity ? capacity : 1;
+			while (new_capacity < expected) new_capacity <<= 1;
+
+			auto new_slots = std::make_unique<T[]>(new_capacity);
+			for (size_t i = 0; i < count; i++)
+			{
+				new_slots[i] = std::move(slots[(head + i) & (capacity - 1)]);
+			}
+			slots = std::move(new_slots);
+			capacity = new_capacity;
+			head = 0;
+		}
+
+		[[nodiscard]] bool Empty() const noexcept { return count == 0; }
+		[[nodiscard]] size_t Size() const noexcept { return count; }
+
+	private:
+		std::unique_ptr<T[]> slots;
+		size_t capacity = 0;
+		size_t head = 0;
+		size_t count = 0;
+	};
+
+	/*
+	* Fixed capacity lock free multi producer multi consumer queue (Dmitry Vyukov's bounded MPMC queue).
+	* Every cell carries a sequence number telling whether it is ready to be written or read in the current lap,
+	* so producers and consumers only contend on their own position counter and never take a lock.
+	* The capacity is rounded up to a power of two. TryPush fails when the queue is full, TryPop when it is empty.
+	* */
+	template <typename T>
+	class BoundedMpmcQueue
+	{
+		static_assert(std::is_nothrow_move_constructible_v<T> && std::is_nothrow_move_assignable_v<T>);
+
+	public:
+		explicit BoundedMpmcQueue(size_t requested_capacity)
+		{
+			capacity = 2;
+			while (capacity < requested_capacity) capacity <<= 1;
+			mask = capacity - 1;
+			cells = std::make_unique<Cell[]>(capacity);
+			for (size_t i = 0; i < capacity; i++)
+			{
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+		BoundedMpmcQueue(const BoundedMpmcQueue&) = delete;
+		BoundedMpmcQueue& operator = (const BoundedMpmcQueue&) = delete;
+
+		[[nodiscard]] bool TryPush(T item) noexcept
+		{
+			auto position = enqueue_position.load(std::memory_order_relaxed);
+			while (true)
+			{
+				auto& cell = cells[position & mask];
+				auto sequence = cell.sequence.load(std::memory_order_acquire);
+				auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+				if (difference == 0)
+				{
+					//the cell is free in this lap, claim it
+					if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						cell.data = std::move(item);
+						cell.sequence.store(position + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (difference < 0)
+				{
+					return false; //the consumer of the previous lap has not got this cell yet, full
+				}
+				else
+				{
+					position = enqueue_position.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		[[nodiscard]] std::optional<T> TryPop() noexcept
+		{
+			auto position = dequeue_position.load(std::memory_order_relaxed);
+			while (true)
+			{
+				auto& cell = cells[position & mask];
+				auto sequence = cell.sequence.load(std::memory_order_acquire);
+				auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+				if (difference == 0)
+				{
+					if (dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						T item = std::move(cell.data);
+						//the cell becomes writable for the producers of the next lap
+						cell.sequence.store(position + mask + 1, std::memory_order_release);
+						return item;
+					}
+				}
+				else if (difference < 0)
+				{
+					return std::nullopt; //empty
+				}
+				else
+				{
+					position = dequeue_position.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		//Approximation when called concurrently
+		[[nodiscard]] size_t Size() const noexcept
+		{
+			auto enqueued = enqueue_position.load(std::memory_order_relaxed);
+			auto dequeued = dequeue_position.load(std::memory_order_relaxed);
+			return enqueued > dequeued ? enqueued - dequeued : 0;
+		}
+
+		[[nodiscard]] bool Empty() const noexcept { return Size() == 0; }
+		[[nodiscard]] size_t Capacity() const noexcept { return capacity; }
+
+	private:
+		struct Cell
+		{
+			std::atomic<size_t> sequence;
+			T data{};
+		};
+
+		std::unique_ptr<Cell[]> cells;
+		size_t capacity;
+		size_t mask;
+		//producers and consumers hammer different counters, keep them on separate cache lines
+		alignas(64) std::atomic<size_t> enqueue_position{ 0 };
+		alignas(64) std::atomic<size_t> dequeue_position{ 0 };
+	};
+}
@@ -0,0 +1,215 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "Task.hpp"
+
+namespace ms
+{
+	/*
+	* Process wide cache of parked threads, the workers of pools created with PoolOptions::reuse_threads come from it
+	* and go back to it when they leave. Starting a job on a parked thread is a mutex and a wakeup instead of a thread
+	* creation, so short lived pools (one per request, per test, per call) don't pay for their threads every time.
+	* A thread parked for keep_alive exits, the cache is emptied at exit.
+	*
+	* At exit only the parked threads are waited for. A thread still running a job (the worker of a pool destroyed after
+	* the cache, which may be waiting for the static destructors still to come) exits once the job is over, its share
+	* of the cache's state keeps the state alive until then.
+	* */
+	class ThreadCache
+	{
+		struct Parked;
+
+	public:
+		static constexpr std::chrono::seconds keep_alive{ 10 };
+
+		/*
+		* Handle of a job started by the cache, or of a plain std::thread. Joining waits for the job, not for the thread,
+		* which goes back to the cache. Like std::thread it can be moved, and must be joined before it is destroyed or assigned.
+		* */
+		class Thread
+		{
+		public:
+			Thread() noexcept = default;
+			explicit Thread(std::thread&& thread) noexcept : thread(std::move(thread)) {}
+			Thread(Thread&&) noexcept = default;
+			Thread& operator = (Thread&&) noexcept = default;
+
+			[[nodiscard]] bool joinable() const noexcept { return thread.joinable() || parked != nullptr; }
+
+			void join()
+			{
+				if (thread.joinable())
+				{
+					thread.join();
+					return;
+				}
+				if (!parked)
+					return;
+				{
+					std::unique_lock lk(parked->mx);
+					parked->cv.wait(lk, [this] { return parked->finished_runs >= run; });
+				}
+				parked.reset();
+			}
+
+		private:
+			friend class ThreadCache;
+			Thread(std::shared_ptr<Parked> parked, uint64_t run) noexcept : parked(std::move(parked)), run(run) {}
+
+			std::thread thread;
+			std::shared_ptr<Parked> parked;
+			uint64_t run = 0;
+		};
+
+		static ThreadCache& Instance()
+		{
+			static ThreadCache cache;
+			return cache;
+		}
+
+		ThreadCache(const ThreadCache&) = delete;
+		ThreadCache& operator = (const ThreadCache&) = delete;
+
+		~ThreadCache()
+		{
+			std::unique_lock lk(shared->mx);
+			shared->stopping = true;
+			Wake(lk);
+			shared->exited_cv.wait(lk, [this] { return shared->leaving == 0; });
+		}
+
+		//runs job (which must not throw) on a parked thread, or on a new one if none is parked
+		[[nodiscard]] Thread Start(Task&& job)
+		{
+			std::unique_lock lk(shared->mx);
+			auto& idle = shared->idle;
+			if (!idle.empty())
+			{
+				auto parked = std::move(idle.back());
+				idle.pop_back();
+				std::unique_lock parked_lk(parked->mx);
+				parked->job = std::move(job);
+				auto run = ++parked->started_runs;
+				parked->cv.notify_all();
+				return Thread(std::move(parked), run);
+			}
+
+			auto parked = std::make_shared<Parked>();
+			parked->job = std::move(job);
+			parked->started_runs = 1;
+			std::thread(&ThreadCache::Park, shared, parked).detach();
+			return Thread(std::move(parked), 1);
+		}
+
+		//threads waiting for a job
+		[[nodiscard]] size_t ParkedCount()
+		{
+			std::unique_lock lk(shared->mx);
+			return shared->idle.size();
+		}
+
+		//lets every parked thread exit now
+		void Trim()
+		{
+			std::unique_lock lk(shared->mx);
+			Wake(lk);
+		}
+
+	private:
+		struct Parked
+		{
+			std::mutex mx;
+			std::condition_variable cv; //a new job for the thread, or the end of one for the joiners
+			Task job;
+			uint64_t started_runs = 0;
+			uint64_t finished_runs = 0;
+			bool leave = false;
+		};
+
+		//owned by the cache and by every thread it started, see the destructor
+		struct Shared
+		{
+			std::mutex mx;
+			std::condition_variable exited_cv;
+			std::vector<std::shared_ptr<Parked>> idle;
+			size_t leaving = 0; //woken by Wake and not gone yet
+			bool stopping = false;
+		};
+
+		ThreadCache() = default;
+
+		//shared->mx is held
+		void Wake(std::unique_lock<std::mutex>&)
+		{
+			for (auto& parked : shared->idle)
+			{
+				std::unique_lock parked_lk(parked->mx);
+				parked->leave = true;
+				parked->cv.notify_all();
+			}
+			shared->leaving += shared->idle.size();
+			shared->idle.clear();
+		}
+
+		static void Park(std::shared_ptr<Shared> shared, std::shared_ptr<Parked> parked) noexcept
+		{
+			auto& idle = shared->idle;
+			bool woken = false;
+			while (true)
+			{
+				Task job;
+				{
+					std::unique_lock lk(parked->mx);
+					if (!parked->cv.wait_for(lk, keep_alive, [&] { return parked->job || parked->leave; }))
+					{
+						lk.unlock();
+						//leaves unless Start took it off the idle list meanwhile, in which case the job is on its way
+						std::unique_lock cache_lk(shared->mx);
+						auto it = std::find(idle.begin(), idle.end(), parked);
+						if (it != idle.end())
+						{
+							idle.erase(it);
+							break;
+						}
+						continue;
+					}
+					if (!parked->job)
+					{
+						woken = true;
+						break;
+					}
+					job = std::move(parked->job);
+				}
+
+				job();
+				job.Reset();
+
+				std::unique_lock cache_lk(shared->mx);
+				{
+					std::unique_lock lk(parked->mx);
+					parked->finished_runs++;
+					parked->cv.notify_all();
+				}
+				if (shared->stopping)
+					return;
+				idle.push_back(parked);
+			}
+
+			if (!woken)
+				return;
+			std::unique_lock lk(shared->mx);
+			if (--shared->leaving == 0)
+				shared->exited_cv.notify_all();
+		}
+
+		std::shared_ptr<Shared> shared = std::make_shared<Shared>();
+	};
+}
@@ -0,0 +1,250 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include "Task.hpp"
+
+namespace ms
+{
+	//a delayed or periodic task of WorkerPool, owned by the pool's timer wheel and recycled once it is over
+	struct TimerEntry
+	{
+		enum class State : uint8_t
+		{
+			Free,
+			Armed, //in the wheel
+			Running, //due and being posted, or a periodic task being run (it goes back to the wheel afterwards)
+			Cancelled //cancelled while running
+		};
+
+		Task task;
+		int64_t due = 0; //tick
+		int64_t period = 0; //ticks, 0 for a one shot timer
+		uint64_t id = 0; //tells a handle from the timers which used the entry before or after it
+		TimerEntry* prev = nullptr;
+		TimerEntry* next = nullptr;
+		uint8_t level = 0;
+		uint8_t slot = 0;
+		State state = State::Free;
+	};
+
+	/*
+	* Returned by WorkerPool::AddTaskAfter/AddTaskAt/AddPeriodicTask, for WorkerPool::CancelTimer.
+	* A plain value: it can be copied, dropped or used after the timer is over. It must not outlive the pool.
+	* */
+	struct TimerHandle
+	{
+		TimerEntry* entry = nullptr;
+		uint64_t id = 0;
+	};
+
+	/*
+	* Hierarchical timer wheel (Varghese and Lauck) counting time in ticks. Not synchronized, the pool guards it with a mutex.
+	* levels wheels of 64 slots, a slot of level L spans 64^L ticks. A timer is placed on the lowest level where its due tick
+	* shares the current block of the level above, in the slot of its due tick, so inserting and removing are O(1) list operations.
+	* When time reaches the start of a slot of a higher level its timers are cascaded down, re-inserted relative to the new time,
+	* and the timers of the level 0 slot of the tick are due. Timers further out than the top level wait on an overflow list.
+	*
+	* Every level keeps a bitmap of its non empty slots, the next tick where anything happens is found with a few bit scans,
+	* so Advance jumps over the empty stretches in between rather than stepping every tick.
+	* */
+	class TimerWheel
+	{
+	public:
+		static constexpr unsigned int levels = 5;
+		static constexpr unsigned int slot_bits = 6;
+		static constexpr unsigned int slots = 1u << slot_bits;
+		static constexpr int64_t no_event = std::numeric_limits<int64_t>::max();
+
+		TimerWheel() = default;
+		TimerWheel(const TimerWheel&) = delete;
+		TimerWheel& operator = (const TimerWheel&) = delete;
+
+		[[nodiscard]] int64_t Current() const noexcept { return current; }
+		[[nodiscard]] size_t Size() const noexcept { return size; }
+
+		//entry->due is set, a timer due at or before the current tick is due on the next Advance
+		void Insert(TimerEntry* entry) noexcept
+		{
+			size++;
+			auto due = entry->due;
+			if (due <= current)
+			{
+				Link(ready, entry, ready_level, 0);
+				return;
+			}
+			for (unsigned int level = 0; level < levels; level++)
+			{
+				if ((due >> (slot_bits * (level + 1))) == (current >> (slot_bits * (level + 1))))
+				{
+					auto slot = static_cast<uint8_t>((due >> (slot_bits * level)) & (slots - 1));
+					Link(wheels[level][slot], entry, static_cast<uint8_t>(level), slot);
+					occupied[level] |= uint64_t(1) << slot;
+					return;
+				}
+			}
+			Link(overflow, entry, overflow_level, 0);
+		}
+
+		void Remove(TimerEntry* entry) noexcept
+		{
+			size--;
+			Unlink(entry);
+		}
+
+		//first tick at which a timer is due or has to be cascaded, no_event if the wheel is empty
+		[[nodiscard]] int64_t NextEventTick() const noexcept
+		{
+			if (ready)
+				return current;
+			auto next = no_event;
+			for (unsigned int level = 0; level < levels; level++)
+			{
+				auto shift = slot_bits * level;
+				auto digit = (current >> shift) & (slots - 1);
+				//the slots past the current one, entries of a level are always ahead of it
+				auto ahead = occupied[level] & ~((uint64_t(2) << digit) - 1);
+				if (ahead)
+				{
+					auto block = (current >> (shift + slot_bits)) << (shift + slot_bits);
+					next = std::min(next, block + (static_cast<int64_t>(std::countr_zero(ahead)) << shift));
+				}
+			}
+			if (overflow)
+				next = std::min(next, ((current >> top_shift) + 1) << top_shift);
+			return next;
+		}
+
+		/*
+		* Moves the time forward to target and hands every timer due until then to expired(TimerEntry*), in due order
+		* (the timers of one tick in no particular order). The entries are out of the wheel by then.
+		* */
+		template <typename Expired>
+		void Advance(int64_t target, Expired&& expired)
+		{
+			while (true)
+			{
+				while (ready)
+				{
+					auto entry = ready;
+					Remove(entry);
+					expired(entry);
+				}
+
+				auto tick = NextEventTick();
+				if (tick > target)
+					break;
+				current = tick;
+
+				//cascades from the top down, the timers due right now end up on the ready list
+				if ((tick & ((int64_t(1) << top_shift) - 1)) == 0)
+					Cascade(overflow);
+				for (unsigned int level = levels - 1; level > 0; level--)
+				{
+					auto shift = slot_bits * level;
+					if ((tick & ((int64_t(1) << shift) - 1)) == 0)
+						Cascade(wheels[level][(tick >> shift) & (slots - 1)]);
+				}
+
+				auto& due_now = wheels[0][tick & (slots - 1)];
+				while (due_now)
+				{
+					auto entry = due_now;
+					Remove(entry);
+					expired(entry);
+				}
+			}
+			current = std::max(current, target);
+		}
+
+		//empties the wheel, on_entry(TimerEntry*) gets every entry
+		template <typename OnEntry>
+		void Clear(OnEntry&& on_entry)
+		{
+			auto clear = [&](TimerEntry*& list) {
+				while (list)
+				{
+					auto entry = list;
+					Remove(entry);
+					on_entry(entry);
+				}
+			};
+			clear(ready);
+			clear(overflow);
+			for (auto& wheel : wheels)
+				for (auto& list : wheel) clear(list);
+		}
+
+	private:
+		static constexpr uint8_t overflow_level = levels;
+		static constexpr uint8_t ready_level = levels + 1;
+		static constexpr unsigned int top_shift = slot_bits * levels;
+
+		void Link(TimerEntry*& head, TimerEntry* entry, uint8_t level, uint8_t slot) noexcept
+		{
+			entry->level = level;
+			entry->slot = slot;
+			entry->prev = nullptr;
+			entry->next = head;
+			if (head)
+				head->prev = entry;
+			head = entry;
+		}
+
+		void Unlink(TimerEntry* entry) noexcept
+		{
+			if (entry->next)
+				entry->next->prev = entry->prev;
+			if (entry->prev)
+			{
+				entry->prev->next = entry->next;
+			}
+			else
+			{
+				auto& head = Head(entry->level, entry->slot);
+				head = entry->next;
+				if (!head && entry->level < levels)
+					occupied[entry->level] &= ~(uint64_t(1) << entry->slot);
+			}
+			entry->prev = entry->next = nullptr;
+		}
+
+		TimerEntry*& Head(uint8_t level, uint8_t slot) noexcept
+		{
+			if (level == ready_level)
+				return ready;
+			if (level == overflow_level)
+				return overflow;
+			return wheels[level][slot];
+		}
+
+		//re-inserts the timers of the list relative to the current tick
+		void Cascade(TimerEntry*& list) noexcept
+		{
+			auto entries = list;
+			if (!entries)
+				return;
+			//detaches the whole list at once, Insert may put some of its entries back on the same list (overflow)
+			if (entries->level < levels)
+				occupied[entries->level] &= ~(uint64_t(1) << entries->slot);
+			list = nullptr;
+			while (entries)
+			{
+				auto entry = entries;
+				entries = entries->next;
+				size--;
+				Insert(entry);
+			}
+		}
+
+		std::array<std::array<TimerEntry*, slots>, levels> wheels{};
+		std::array<uint64_t, levels> occupied{};
+		TimerEntry* overflow = nullptr;
+		TimerEntry* ready = nullptr;
+		int64_t current = 0;
+		size_t size = 0;
+	};
+}
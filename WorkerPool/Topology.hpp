@@ -0,0 +1,150 @@
+#pragma once
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(_WIN32)
+//the includers of WorkerPool.hpp get windows.h too, keep it to the core APIs and without the min/max macros
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace ms
+{
+	/*
+	* Cpus of every NUMA node of the machine, read once.
+	* Linux: /sys/devices/system/node, Windows: the processor masks of the nodes (first processor group only).
+	* Where the topology is not known the machine is a single node holding hardware_concurrency cpus.
+	* */
+	class CpuTopology
+	{
+	public:
+		explicit CpuTopology(std::vector<std::vector<unsigned int>> nodes) : nodes(std::move(nodes))
+		{
+			if (this->nodes.empty())
+				this->nodes.push_back(AllCpus());
+		}
+
+		[[nodiscard]] static const CpuTopology& System()
+		{
+			static const CpuTopology system(Discover());
+			return system;
+		}
+
+		[[nodiscard]] size_t NodeCount() const noexcept { return nodes.size(); }
+
+		[[nodiscard]] const std::vector<unsigned int>& CpusOfNode(size_t node) const { return nodes[node]; }
+
+		/*
+		* Binds the calling thread to the given cpus (pthread_setaffinity_np / SetThreadAffinityMask).
+		* Returns false if that is not supported or the OS refused, the thread then keeps running wherever it was allowed to.
+		* */
+		static bool PinCurrentThread(const std::vector<unsigned int>& cpus) noexcept
+		{
+			if (cpus.empty())
+				return false;
+#if defined(_WIN32)
+			DWORD_PTR mask = 0;
+			for (auto cpu : cpus)
+			{
+				if (cpu < sizeof(DWORD_PTR) * 8)
+					mask |= DWORD_PTR(1) << cpu;
+			}
+			return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(__linux__)
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			for (auto cpu : cpus)
+			{
+				if (cpu < CPU_SETSIZE)
+					CPU_SET(cpu, &set);
+			}
+			return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+			return false;
+#endif
+		}
+
+	private:
+		static std::vector<unsigned int> AllCpus()
+		{
+			std::vector<unsigned int> cpus(std::max(std::thread::hardware_concurrency(), 1u));
+			for (unsigned int i = 0; i < cpus.size(); i++) cpus[i] = i;
+			return cpus;
+		}
+
+		static std::vector<std::vector<unsigned int>> Discover()
+		{
+			std::vector<std::vector<unsigned int>> nodes;
+#if defined(_WIN32)
+			ULONG highest_node = 0;
+			if (GetNumaHighestNodeNumber(&highest_node))
+			{
+				for (ULONG node = 0; node <= highest_node; node++)
+				{
+					ULONGLONG mask = 0;
+					if (!GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask) || mask == 0)
+						continue;
+					std::vector<unsigned int> cpus;
+					for (unsigned int cpu = 0; cpu < 64; cpu++)
+					{
+						if (mask & (ULONGLONG(1) << cpu))
+							cpus.push_back(cpu);
+					}
+					nodes.push_back(std::move(cpus));
+				}
+			}
+#elif defined(__linux__)
+			//nodes may be numbered sparsely, stop after a run of missing ones
+			for (unsigned int node = 0, missing = 0; missing < 64; node++)
+			{
+				std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+				std::string list;
+				if (!file || !std::getline(file, list))
+				{
+					missing++;
+					continue;
+				}
+				missing = 0;
+				auto cpus = ParseCpuList(list);
+				if (!cpus.empty())
+					nodes.push_back(std::move(cpus));
+			}
+#endif
+			return nodes;
+		}
+
+		//"0-3,8,10-11" style lists, as found in sysfs
+		static std::vector<unsigned int> ParseCpuList(const std::string& list)
+		{
+			std::vector<unsigned int> cpus;
+			size_t position = 0;
+			while (position < list.size())
+			{
+				auto end = list.find(',', position);
+				if (end == std::string::npos) end = list.size();
+				auto range = list.substr(position, end - position);
+				position = end + 1;
+				if (range.empty() || range.find_first_not_of("0123456789-\n ") != std::string::npos)
+					continue;
+
+				auto dash = range.find('-');
+				auto first = static_cast<unsigned int>(std::stoul(range.substr(0, dash)));
+				auto last = dash == std::string::npos ? first : static_cast<unsigned int>(std::stoul(range.substr(dash + 1)));
+				for (auto cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+			}
+			return cpus;
+		}
+
+		std::vector<std::vector<unsigned int>> nodes;
+	};
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace ms
+{
+	/*
+	* Scheduling events the pool reports to a tracing backend
+	* Enqueue - a task was queued, on the submitting thread
+	* Dequeue - a worker took the task from one of the queues
+	* Start, Finish - execution of the task, callback included. Inline executions (see OverflowPolicy) have no Dequeue
+	* */
+	enum class TracePoint : uint8_t
+	{
+		Enqueue,
+		Dequeue,
+		Start,
+		Finish
+	};
+
+	/*
+	* task identifies the task between its events (the address of the pool's record, reused once the task is over),
+	* worker is the index of the calling worker or ~0u for any other thread, time_ns is steady_clock's time since epoch.
+	* Called on the pool's hot paths, it has to be cheap and must not throw.
+	* */
+	using TraceHook = void (*)(TracePoint point, const void* task, unsigned int worker, int64_t time_ns) noexcept;
+
+	/*
+	* The trace points are compiled in only with WORKERPOOL_TRACING defined (for the whole program, the pool is header only),
+	* then each one costs a relaxed load and a branch while no hook is installed.
+	* */
+	inline std::atomic<TraceHook> trace_hook{ nullptr };
+
+	inline void SetTraceHook(TraceHook hook) noexcept
+	{
+		trace_hook.store(hook, std::memory_order_release);
+	}
+
+	inline void TraceEvent(TracePoint point, const void* task, unsigned int worker, std::chrono::steady_clock::time_point time) noexcept
+	{
+		if (auto hook = trace_hook.load(std::memory_order_acquire))
+			hook(point, task, worker, std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count());
+	}
+
+	//reads the clock only when a hook is installed
+	inline void TraceEvent(TracePoint point, const void* task, unsigned int worker) noexcept
+	{
+		if (auto hook = trace_hook.load(std::memory_order_acquire))
+			hook(point, task, worker, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+}
+
+#if defined(WORKERPOOL_TRACING)
+#define WORKERPOOL_TRACE(...) ::ms::TraceEvent(__VA_ARGS__)
+#else
+#define WORKERPOOL_TRACE(...) ((void)0)
+#endif
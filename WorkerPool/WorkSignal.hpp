@@ -0,0 +1,180 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace ms
+{
+	/*
+	* How an idle worker waits for the next task
+	* Park - goes to sleep right away (futex style wait), every handoff to it costs a kernel wakeup
+	* SpinThenPark - spins with the cpu pause instruction, then yields, then parks. Short gaps between tasks are bridged
+	*			without any syscall on either side, at the price of some cpu time burnt while idle
+	* Spin - spins and yields without ever parking. Lowest latency, but idle workers keep their cores busy
+	* */
+	enum class WaitStrategy
+	{
+		Park,
+		SpinThenPark,
+		Spin
+	};
+
+	inline void CpuRelax() noexcept
+	{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		_mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+		_mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+		__asm__ __volatile__("yield");
+#endif
+	}
+
+	/*
+	* Counts the queued tasks no worker has claimed yet and parks/wakes the idle workers, in place of std::counting_semaphore.
+	* Release(n) adds n tokens, Acquire() takes one. Submitters only pay for a wakeup (atomic notify, a futex syscall on Linux)
+	* when somebody is parked and not enough workers are spinning to pick the new tokens up.
+	* */
+	class WorkSignal
+	{
+	public:
+		WorkSignal(WaitStrategy strategy, uint32_t spin_count, uint32_t yield_count) noexcept
+			: strategy(strategy), spin_count(spin_count), yield_count(yield_count) {}
+		WorkSignal(const WorkSignal&) = delete;
+		WorkSignal& operator = (const WorkSignal&) = delete;
+
+		void Release(int64_t count = 1) noexcept
+		{
+			tokens.fetch_add(count, std::memory_order_seq_cst);
+			//a spinning worker is bound to see the new tokens, don't pay for a wakeup on its behalf
+			if (sleepers.load(std::memory_order_seq_cst) > 0 && spinning.load(std::memory_order_seq_cst) < count)
+				Wake(count);
+		}
+
+		[[nodiscard]] bool TryAcquire() noexcept
+		{
+			auto available = tokens.load(std::memory_order_relaxed);
+			while (available > 0)
+			{
+				if (tokens.compare_exchange_weak(available, available - 1, std::memory_order_acquire, std::memory_order_relaxed))
+					return true;
+			}
+			return false;
+		}
+
+		void Acquire() noexcept
+		{
+			if (TryAcquire())
+				return;
+
+			if (strategy != WaitStrategy::Park && SpinAcquire())
+				return;
+
+			sleepers.fetch_add(1, std::memory_order_seq_cst);
+			while (true)
+			{
+				auto current_epoch = epoch.load(std::memory_order_seq_cst);
+				if (TryAcquire())
+					break;
+				epoch.wait(current_epoch, std::memory_order_seq_cst);
+			}
+			sleepers.fetch_sub(1, std::memory_order_seq_cst);
+		}
+
+		/*
+		* Acquire giving up after timeout, returns false if no token was taken by then.
+		* Atomic wait has no timed version, so timed waiters park on a condition variable, which Release only touches while
+		* one of them is parked. Meant for the workers of an elastic pool, which retire after waiting idle for too long.
+		* */
+		[[nodiscard]] bool AcquireFor(std::chrono::nanoseconds timeout)
+		{
+			if (TryAcquire())
+				return true;
+
+			if (strategy != WaitStrategy::Park && SpinAcquire())
+				return true;
+
+			auto deadline = std::chrono::steady_clock::now() + timeout;
+			std::unique_lock lk(timed_mx);
+			//timed_sleepers first, a releaser which sees the sleeper has to see it as a timed one
+			timed_sleepers.fetch_add(1, std::memory_order_seq_cst);
+			sleepers.fetch_add(1, std::memory_order_seq_cst);
+			bool acquired = false;
+			while (!(acquired = tokens.load(std::memory_order_seq_cst) > 0 && TryAcquire()))
+			{
+				if (timed_cv.wait_until(lk, deadline) == std::cv_status::timeout)
+				{
+					acquired = TryAcquire();
+					break;
+				}
+			}
+			sleepers.fetch_sub(1, std::memory_order_seq_cst);
+			timed_sleepers.fetch_sub(1, std::memory_order_seq_cst);
+			return acquired;
+		}
+
+		[[nodiscard]] int64_t Pending() const noexcept { return tokens.load(std::memory_order_relaxed); }
+
+	private:
+		bool SpinAcquire() noexcept
+		{
+			spinning.fetch_add(1, std::memory_order_seq_cst);
+			bool acquired = false;
+			for (uint32_t round = 0; !acquired; round++)
+			{
+				if (round < spin_count)
+					CpuRelax();
+				else if (strategy == WaitStrategy::Spin || round < spin_count + yield_count)
+					std::this_thread::yield();
+				else
+					break;
+				acquired = TryAcquire();
+			}
+			spinning.fetch_sub(1, std::memory_order_seq_cst);
+
+			/*
+			* Submitters skipped the wakeup counting on this worker. If more tokens are left behind and nobody else spins,
+			* pass the wakeup on, otherwise a parked worker could sleep through queued work while this one is busy.
+			* */
+			if (acquired && tokens.load(std::memory_order_seq_cst) > 0 && spinning.load(std::memory_order_seq_cst) == 0 && sleepers.load(std::memory_order_seq_cst) > 0)
+				Wake(1);
+			return acquired;
+		}
+
+		void Wake(int64_t count) noexcept
+		{
+			epoch.fetch_add(1, std::memory_order_seq_cst);
+			if (count == 1)
+				epoch.notify_one();
+			else
+				epoch.notify_all();
+
+			if (timed_sleepers.load(std::memory_order_seq_cst) > 0)
+			{
+				//taking the mutex orders the new tokens before the timed waiter's check, or the notify after its wait started
+				{ std::lock_guard lk(timed_mx); }
+				timed_cv.notify_all();
+			}
+		}
+
+		const WaitStrategy strategy;
+		const uint32_t spin_count;
+		const uint32_t yield_count;
+
+		alignas(64) std::atomic<int64_t> tokens{ 0 };
+		alignas(64) std::atomic<uint32_t> spinning{ 0 };
+		std::atomic<uint32_t> sleepers{ 0 };
+		alignas(64) std::atomic<uint32_t> epoch{ 0 };
+		std::atomic<uint32_t> timed_sleepers{ 0 };
+		std::mutex timed_mx;
+		std::condition_variable timed_cv;
+	};
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+namespace ms
+{
+	/*
+	* Chase-Lev work stealing deque (the C11 formulation from "Correct and Efficient Work-Stealing for Weak Memory Models", Le et al.)
+	* Only the owning thread may call Push and Pop, which work on the bottom end (LIFO, cache friendly for the owner).
+	* Any thread may call Steal, which takes from the top end (FIFO, oldest work first).
+	*
+	* The element type has to be trivially copyable because a thief reads the slot before it knows if it has won the race,
+	* in practice it holds pointers to task records.
+	* */
+	template <typename T>
+	class WorkStealingDeque
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "WorkStealingDeque elements are read speculatively by thieves, use pointers or trivial types");
+
+		struct Buffer
+		{
+			explicit Buffer(int64_t capacity) : capacity(capacity), mask(capacity - 1), slots(new std::atomic<T>[capacity]) {}
+
+			T Load(int64_t index) const noexcept { return slots[index & mask].load(std::memory_order_relaxed); }
+			void Store(int64_t index, T value) noexcept { slots[index & mask].store(value, std::memory_order_relaxed); }
+
+			Buffer* Grow(int64_t top, int64_t bottom) const
+			{
+				auto bigger = new Buffer(capacity * 2);
+				for (auto i = top; i < bottom; i++)
+				{
+					bigger->Store(i, Load(i));
+				}
+				return bigger;
+			}
+
+			const int64_t capacity;
+			const int64_t mask;
+			std::unique_ptr<std::atomic<T>[]> slots;
+		};
+
+	public:
+		explicit WorkStealingDeque(int64_t initial_capacity = 256) : top(0), bottom(0)
+		{
+			//capacity has to stay a power of two for the index masking
+			int64_t capacity = 1;
+			while (capacity < initial_capacity) capacity <<= 1;
+			buffers.emplace_back(std::make_unique<Buffer>(capacity));
+			buffer.store(buffers.back().get(), std::memory_order_relaxed);
+		}
+		WorkStealingDeque(const WorkStealingDeque&) = delete;
+		WorkStealingDeque& operator = (const WorkStealingDeque&) = delete;
+
+		//Owner only
+		void Push(T item)
+		{
+			auto b = bottom.load(std::memory_order_relaxed);
+			auto t = top.load(std::memory_order_acquire);
+			auto a = buffer.load(std::memory_order_relaxed);
+			if (b - t > a->capacity - 1)
+			{
+				/*
+				* Thieves may still be reading from the old buffer, so it is retired instead of being freed.
+				* Only the owner touches 'buffers' and the total size retired is bounded by twice the largest buffer
+				* */
+				buffers.emplace_back(a->Grow(t, b));
+				a = buffers.back().get();
+				buffer.store(a, std::memory_order_release);
+			}
+			a->Store(b, item);
+			std::atomic_thread_fence(std::memory_order_release);
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+
+		//Owner only
+		std::optional<T> Pop()
+		{
+			auto b = bottom.load(std::memory_order_relaxed) - 1;
+			auto a = buffer.load(std::memory_order_relaxed);
+			bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			auto t = top.load(std::memory_order_relaxed);
+
+			if (t > b)
+			{
+				//deque was already empty
+				bottom.store(b + 1, std::memory_order_relaxed);
+				return std::nullopt;
+			}
+
+			T item = a->Load(b);
+			if (t == b)
+			{
+				//last element, race against the thieves for it
+				bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+				bottom.store(b + 1, std::memory_order_relaxed);
+				if (!won) return std::nullopt;
+			}
+			return item;
+		}
+
+		/*
+		* Can be called from any thread.
+		* Returns nullopt if the deque is empty or if another thread won the race for the top element, callers simply try again or move on to the next victim
+		* */
+		std::optional<T> Steal()
+		{
+			auto t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			auto b = bottom.load(std::memory_order_acquire);
+			if (t >= b) return std::nullopt;
+
+			auto a = buffer.load(std::memory_order_acquire);
+			T item = a->Load(t);
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				return std::nullopt;
+			return item;
+		}
+
+		//Approximation when called concurrently with Push/Pop/Steal
+		[[nodiscard]] size_t Size() const noexcept
+		{
+			auto b = bottom.load(std::memory_order_relaxed);
+			auto t = top.load(std::memory_order_relaxed);
+			return b > t ? static_cast<size_t>(b - t) : 0;
+		}
+
+		[[nodiscard]] bool Empty() const noexcept { return Size() == 0; }
+
+	private:
+		//top and bottom are written by different threads, keep them on separate cache lines
+		alignas(64) std::atomic<int64_t> top;
+		alignas(64) std::atomic<int64_t> bottom;
+		alignas(64) std::atomic<Buffer*> buffer;
+		std::vector<std::unique_ptr<Buffer>> buffers;
+	};
+}
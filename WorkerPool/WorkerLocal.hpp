@@ -0,0 +1,107 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "WorkerPool.hpp"
+
+namespace ms
+{
+	/*
+	* One instance of T per worker of a pool, for tasks that accumulate into per worker state (sums, histograms,
+	* partial vectors) instead of a shared atomic or a result allocated per task. Local() finds the calling worker's
+	* instance with WorkerPool::CurrentWorkerIndex(), the instances are cache line padded and only ever touched by
+	* their worker, so updating them needs neither a lock nor an atomic.
+	* An instance is created on the first Local() of its thread, with make() or value initialized.
+	*
+	* Threads outside the pool (a caller running part of the work inline) get an instance of their own too,
+	* found under a mutex: hold on to the reference rather than calling Local() per element there.
+	*
+	* ForEach and Combine read every instance, they are for after the tasks updating them have been joined
+	* (a CompletionHandle, TaskGroup::Wait, ParallelFor returning...). So is Clear.
+	* */
+	template <typename T>
+	class WorkerLocal
+	{
+	public:
+		explicit WorkerLocal(WorkerPool& pool) : WorkerLocal(pool, [] { return T(); }) {}
+
+		template <typename Make>
+		WorkerLocal(WorkerPool& pool, Make&& make) : pool(pool), make(std::forward<Make>(make)), slots(pool.Capacity()) {}
+
+		WorkerLocal(const WorkerLocal&) = delete;
+		WorkerLocal& operator = (const WorkerLocal&) = delete;
+
+		//the calling thread's instance
+		[[nodiscard]] T& Local()
+		{
+			auto worker = pool.CurrentWorkerIndex();
+			auto& value = worker >= 0 ? slots[static_cast<size_t>(worker)].value : OutsideSlot().value;
+			if (!value)
+				value.emplace(make());
+			return *value;
+		}
+
+		//f(T&) for every instance created so far, the workers' in index order then the other threads'
+		template <typename F>
+		void ForEach(F&& f)
+		{
+			for (auto& slot : slots)
+			{
+				if (slot.value)
+					f(*slot.value);
+			}
+			for (auto& [thread, slot] : outside)
+			{
+				if (slot->value)
+					f(*slot->value);
+			}
+		}
+
+		//op(op(make(), first), second)... over every instance, like ParallelReduce op has to be associative and commutative
+		template <typename Op>
+		[[nodiscard]] T Combine(Op&& op)
+		{
+			auto result = make();
+			ForEach([&result, &op](T& value) { result = op(std::move(result), value); });
+			return result;
+		}
+
+		//drops every instance, the next Local() of each thread starts over from make()
+		void Clear()
+		{
+			for (auto& slot : slots) slot.value.reset();
+			outside.clear();
+		}
+
+	private:
+		struct alignas(64) Slot
+		{
+			std::optional<T> value;
+		};
+
+		Slot& OutsideSlot()
+		{
+			std::unique_lock lk(outside_mx);
+			auto id = std::this_thread::get_id();
+			for (auto& [thread, slot] : outside)
+			{
+				if (thread == id)
+					return *slot;
+			}
+			return *outside.emplace_back(id, std::make_unique<Slot>()).second;
+		}
+
+		WorkerPool& pool;
+		std::function<T()> make;
+		std::vector<Slot> slots; //indexed by worker
+		std::mutex outside_mx;
+		std::vector<std::pair<std::thread::id, std::unique_ptr<Slot>>> outside;
+	};
+
+	template <typename T>
+	using Combinable = WorkerLocal<T>;
+}
@@ -5,30 +5,220 @@
 #include <queue>
 #include <algorithm>
 #include <functional>
-#include <semaphore>
 #include <assert.h>
 #include <future>
 #include <tuple>
+#include <atomic>
+#include <optional>
+#include <ranges>
+#include <chrono>
+#include <array>
+#include <coroutine>
+#include <memory_resource>
+#include <condition_variable>
+#include "Task.hpp"
+#include "Completion.hpp"
+#include "TaskQueue.hpp"
+#include "RecyclingPool.hpp"
+#include "WorkStealingDeque.hpp"
+#include "WorkSignal.hpp"
+#include "Statistics.hpp"
+#include "Topology.hpp"
+#include "Tracing.hpp"
+#include "Timers.hpp"
+#include "ThreadCache.hpp"
 
 namespace ms
 {
-	using Task = std::function<void()>;
+	/*
+	* Selects how the tasks are handed over to the worker threads
+	* GlobalQueue - all the submissions and all the pulls go through a single queue guarded by a mutex
+	* WorkStealing - every worker owns a local deque, tasks submitted from inside a worker go to that worker's deque
+	*			and idle workers steal from the others. The global queue is used only for submissions from outside the pool
+	* */
+	enum class SchedulerMode
+	{
+		GlobalQueue,
+		WorkStealing
+	};
+
+	/*
+	* What a submission does when the bounded global queue is full (see PoolOptions::queue_capacity)
+	* Block - waits until a worker makes room
+	* SpinWithTimeout - keeps retrying for PoolOptions::spin_timeout, then throws std::runtime_error
+	* TryPost never waits, it returns false instead.
+	* A submission made by one of the pool's own workers never waits on a full queue, the task is run inline instead.
+	* */
+	enum class OverflowPolicy
+	{
+		Block,
+		SpinWithTimeout
+	};
+
+	/*
+	* Lane a task is queued in, the workers serve the lanes in this order (tasks with a deadline come before all of them).
+	* A lower lane which has had work waiting for PoolOptions::aging_threshold without being served is picked first,
+	* so a steady stream of urgent tasks can delay background work but never starve it.
+	* */
+	enum class Priority
+	{
+		High,
+		Normal,
+		Background
+	};
+
+	/*
+	* When and how the worker threads are started
+	* Eager - the constructor starts them one after the other
+	* Parallel - the constructor starts the first one, and every thread starts half of the ones left to it before it waits
+	*			for tasks. The constructor returns right away and all the threads are up after log2(n) thread creations
+	* Lazy - as Parallel, but on the first submission (or WaitUntilReady, Resize), a pool which is never used starts no thread
+	* WaitUntilReady returns once they are all waiting for tasks.
+	* */
+	enum class ThreadStart
+	{
+		Eager,
+		Parallel,
+		Lazy
+	};
+
+	//submission hint, Post(NumaNode{ n }, task) queues the task on the workers of node n (see PoolOptions::numa_aware)
+	struct NumaNode
+	{
+		unsigned int index;
+	};
+
+	struct PoolOptions
+	{
+		unsigned int capacity = std::thread::hardware_concurrency();
+		SchedulerMode mode = SchedulerMode::GlobalQueue;
+		/*
+		* 0 keeps the global queue unbounded (a ring guarded by a mutex).
+		* Anything else makes it a fixed size lock free ring (rounded up to a power of two) which bounds the memory
+		* taken by queued tasks and removes the queue mutex from the hot path.
+		* */
+		size_t queue_capacity = 0;
+		OverflowPolicy overflow_policy = OverflowPolicy::Block;
+		std::chrono::microseconds spin_timeout{ 1'000 };
+		/*
+		* How idle workers wait for tasks. With SpinThenPark a worker spins spin_count times (cpu pause),
+		* then yields yield_count times before it parks
+		* */
+		WaitStrategy wait_strategy = WaitStrategy::Park;
+		uint32_t spin_count = 2'000;
+		uint32_t yield_count = 20;
+		//anti-starvation aging of the priority lanes (see Priority)
+		std::chrono::microseconds aging_threshold{ 10'000 };
+		/*
+		* Elastic sizing, max_threads = 0 keeps the pool at capacity threads.
+		* Otherwise the pool starts with capacity threads (clamped to [min_threads, max_threads]) and adds one more, up to max_threads,
+		* whenever no worker is idle and either more than growth_backlog tasks are queued or a task waited in the queue for
+		* longer than growth_wait. A thread idle for idle_timeout retires as long as more than min_threads are left.
+		* */
+		unsigned int min_threads = 1;
+		unsigned int max_threads = 0;
+		size_t growth_backlog = 0;
+		std::chrono::microseconds growth_wait{ 1'000 };
+		std::chrono::milliseconds idle_timeout{ 30'000 };
+		/*
+		* Worker placement
+		* numa_aware - groups the workers by NUMA node (contiguous indices per node) and gives every group its own queue.
+		*			Post(NumaNode{ n }, ...) targets a group, submissions from a worker stay in its group, and idle workers
+		*			look at their own node's queue and deques before the remote ones
+		* numa_nodes - cpus of every node, empty reads the machine's topology (see CpuTopology)
+		* pin_workers - binds every worker to cpu_sets[index % cpu_sets.size()], or without cpu_sets to the cpus of its node
+		*			in a numa_aware pool and to a single cpu (round robin) otherwise
+		* */
+		bool numa_aware = false;
+		std::vector<std::vector<unsigned int>> numa_nodes;
+		bool pin_workers = false;
+		std::vector<std::vector<unsigned int>> cpu_sets;
+		/*
+		* Batched dequeue from the unbounded global queue. A worker moves up to dequeue_batch tasks (at most 64) in one lock
+		* of the queue to its own deque, where the other workers can still steal them. It takes its fair share of the queue
+		* (queued tasks / threads), and a single task while its recent tasks ran longer than batch_task_duration: the lock is
+		* cheap next to such tasks and holding more of them would only hurt the balance. 1 disables batching
+		* */
+		size_t dequeue_batch = 32;
+		std::chrono::microseconds batch_task_duration{ 20 };
+		/*
+		* Where the pool's per task memory comes from: task records, completion slots and the promise shared state of
+		* AddTaskForExecution. nullptr is the heap. Records and slots are carved out of slabs and recycled through
+		* per worker free lists (see RecyclingPool), so they only hit the resource while the pool warms up; every promise does.
+		* It has to be thread safe (std::pmr::synchronized_pool_resource for instance) and outlive the pool.
+		* */
+		std::pmr::memory_resource* memory_resource = nullptr;
+		//false allocates every task record and completion slot from memory_resource and frees it after the task, see RecyclingPool
+		bool recycle_records = true;
+		//granularity of the timers (AddTaskAfter...), due times are rounded up to it
+		std::chrono::microseconds timer_resolution{ 1'000 };
+		ThreadStart thread_start = ThreadStart::Eager;
+		/*
+		* Takes the worker threads from the process wide ThreadCache and gives them back to it when they leave, instead of
+		* creating and joining threads. Makes constructing and destroying pools over and over cheap. Not for pinned workers.
+		* */
+		bool reuse_threads = false;
+	};
+
+	class ExecutorView;
 
 	class WorkerPool
 	{
 	public:
 		#pragma region Special member functions
-		WorkerPool(unsigned int capacity = std::thread::hardware_concurrency()) : capacity(capacity), is_ready(0), cancel_flag(false), available_workers(0)
+		WorkerPool(unsigned int capacity = std::thread::hardware_concurrency()) : WorkerPool(DefaultOptions(capacity)) {}
+
+		WorkerPool(const PoolOptions& options) : cancel_flag(false), capacity(SlotCount(options)), mode(options.mode),
+			elastic(options.max_threads > 0), growth_backlog(options.growth_backlog), growth_wait(options.growth_wait), idle_timeout(options.idle_timeout),
+			overflow_policy(options.overflow_policy), spin_timeout(options.spin_timeout),
+			aging_threshold_ns(std::chrono::duration_cast<std::chrono::nanoseconds>(options.aging_threshold).count()),
+			dequeue_batch(std::clamp<size_t>(options.dequeue_batch, 1, max_dequeue_batch)),
+			batch_task_ns(std::chrono::duration_cast<std::chrono::nanoseconds>(options.batch_task_duration).count()), available_workers(0),
+			memory_resource(options.memory_resource),
+			records(capacity, memory_resource, options.recycle_records), completions(capacity, memory_resource, options.recycle_records), timer_entries(0, memory_resource),
+			timer_tick_ns(std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(options.timer_resolution).count()))
 		{
-			assert(capacity <= max_threads);
-			pull_task_signal = std::make_unique<std::counting_semaphore<max_threads* max_threads>>(0);
-			_threads.reserve(this->capacity);
+			assert(capacity <= thread_limit);
+			pull_task_signal = std::make_unique<WorkSignal>(options.wait_strategy, options.spin_count, options.yield_count);
+			if (options.queue_capacity > 0)
+				bounded_queue = std::make_unique<BoundedMpmcQueue<TaskRecord*>>(options.queue_capacity);
+
+			//the local deques of all the slots have to exist before any worker can look into them, an elastic pool reuses them
+			workers.reserve(this->capacity);
 			for (unsigned int i = 0; i < this->capacity; i++)
 			{
-				_threads.emplace_back(&WorkerPool::routine, this);
+				workers.emplace_back(std::make_unique<WorkerData>());
+			}
+			ConfigurePlacement(options);
+
+			initial_threads = options.capacity;
+			if (elastic)
+			{
+				min_threads = std::clamp(options.min_threads, 1u, capacity);
+				initial_threads = std::clamp(options.capacity, min_threads.load(), capacity);
+			}
+			else
+			{
+				min_threads = capacity;
+			}
+
+			_threads.resize(this->capacity);
+			reuse_threads = options.reuse_threads;
+			if (options.thread_start == ThreadStart::Lazy)
+				return;
+			std::unique_lock lk(resize_mx);
+			if (options.thread_start == ThreadStart::Parallel)
+			{
+				StartInitialThreads();
+				return;
+			}
+			for (unsigned int i = 0; i < initial_threads; i++)
+			{
+				StartWorker(i);
 			}
+			threads_started.store(true, std::memory_order_release);
 		}
-		WorkerPool(const WorkerPool&) = delete; //cant allow copy as std::thread doesn't allow copy 
+		WorkerPool(const WorkerPool&) = delete; //cant allow copy as std::thread doesn't allow copy
 		WorkerPool(WorkerPool&&) = default;
 		WorkerPool& operator = (const WorkerPool&) = delete;
 		WorkerPool& operator = (WorkerPool&&) = default;
@@ -39,109 +229,1944 @@ namespace ms
 		* */
 		~WorkerPool()
 		{
-			cancel_flag = true;
-			pull_task_signal->release(_threads.size());
+			StopTimers();
+			{
+				//no thread can be started after this
+				std::unique_lock lk(resize_mx);
+				cancel_flag = true;
+			}
+			pull_task_signal->Release(static_cast<int64_t>(_threads.size()));
+			//threads still starting others have to be done with it before the handles can be joined
+			WaitForZero(unstored_threads);
 
 			//This is necessary, otherwise the abort is called. you can see in the std::thread's dtor
 			for (auto& t : _threads)
 			{
-				t.join();
+				if (t.joinable())
+					t.join();
 			}
 		}
 		#pragma endregion
 
-		[[nodiscard]] bool IsWorkersAvailable() { return is_ready && (available_workers > 0); };
+		[[nodiscard]] bool IsWorkersAvailable() { return available_workers > 0; };
+
+		//true once every thread started so far is waiting for tasks (or running one), see WaitUntilReady
+		[[nodiscard]] bool IsReady() const noexcept
+		{
+			return threads_started.load(std::memory_order_acquire) && starting_threads.load(std::memory_order_acquire) == 0;
+		}
+
+		/*
+		* Blocks until every thread started so far is waiting for tasks (or running one), starts the threads of a
+		* ThreadStart::Lazy pool first. Threads added later by Resize or elastic growth are waited for by the next call.
+		* */
+		void WaitUntilReady()
+		{
+			EnsureStarted();
+			WaitForZero(starting_threads);
+		}
 
 		[[nodiscard]] bool AreAllWorkersAvailable() {
-			return available_workers == capacity;
+			return available_workers == static_cast<int>(live_threads.load());
+		}
+
+		[[nodiscard]] SchedulerMode Mode() const noexcept { return mode; }
+
+		//maximum number of worker threads, PoolOptions::max_threads for an elastic pool and capacity otherwise
+		[[nodiscard]] unsigned int Capacity() const noexcept { return capacity; }
+
+		[[nodiscard]] unsigned int NodeCount() const noexcept { return node_queues.empty() ? 1 : static_cast<unsigned int>(node_queues.size()); }
+
+		//NUMA node of the worker slot, 0 unless the pool is numa_aware
+		[[nodiscard]] unsigned int NodeOfWorker(unsigned int index) const noexcept { return workers[index]->node; }
+
+		//number of worker threads currently running, including the ones asked to retire which have not left yet
+		[[nodiscard]] unsigned int ThreadCount() const noexcept { return live_threads.load(std::memory_order_relaxed); }
+
+		/*
+		* Sets the number of worker threads to thread_count, clamped to [1, Capacity()], and makes it the floor idle threads
+		* retire down to. Surplus threads leave as soon as they are idle, a thread busy with a task finishes it first.
+		* An elastic pool keeps growing past thread_count under load, up to Capacity().
+		* */
+		void Resize(unsigned int thread_count)
+		{
+			thread_count = std::clamp(thread_count, 1u, capacity);
+			std::unique_lock lk(resize_mx);
+			if (cancel_flag)
+				return;
+			if (!threads_started.load(std::memory_order_relaxed))
+				StartInitialThreads();
+			//the slots of a parallel start are only known to be free or taken once it is over
+			WaitForZero(unstored_threads);
+			min_threads = thread_count;
+
+			auto staying = live_threads.load() - retire_requests.load();
+			if (thread_count < staying)
+			{
+				//every retirement rides on a token, the first worker to take one leaves instead of looking for a task
+				retire_requests += staying - thread_count;
+				pull_task_signal->Release(staying - thread_count);
+				return;
+			}
+
+			auto missing = thread_count - staying;
+			//call off pending retirements first, their tokens are taken back unless a worker already holds them
+			while (missing > 0 && retire_requests.load() > 0 && pull_task_signal->TryAcquire())
+			{
+				if (TryConsumeRetireRequest())
+					missing--;
+				else
+					pull_task_signal->Release(); //raced with a worker, this token stands for a task
+			}
+
+			while (missing > 0)
+			{
+				auto slot = FindFreeSlot();
+				if (slot == capacity)
+				{
+					//the retirements which could not be called off are held by workers on their way out, their slots free up shortly
+					std::this_thread::yield();
+					continue;
+				}
+				StartWorker(slot);
+				missing--;
+			}
+		}
+
+		/*
+		* Index in [0, Capacity()) of the worker running on the calling thread, or -1 if the caller is not one of this pool's workers.
+		* Handy to keep per worker data (partial results, counters) in a plain array without any synchronization
+		* */
+		[[nodiscard]] int CurrentWorkerIndex() const noexcept
+		{
+			return current_worker.pool == this ? static_cast<int>(current_worker.index) : -1;
+		}
+
+		/*
+		* Runs one queued task on the calling thread, for code that waits on other tasks from inside a task.
+		* Returns false without running anything if nothing is queued or the caller is not one of this pool's workers.
+		* */
+		bool RunPendingTask() noexcept;
+
+		/*
+		* Keeps running queued tasks while keep_waiting() returns true, so a task waiting for the ones it forked (fork-join,
+		* divide and conquer) lends its worker to them instead of blocking it. With every worker waiting like that, blocking
+		* would deadlock the pool. Backs off to short sleeps while there is nothing to run.
+		* Meant for the pool's workers, on any other thread it only polls keep_waiting.
+		* */
+		template <typename Predicate>
+		void HelpWhile(Predicate&& keep_waiting)
+		{
+			for (unsigned int idle = 0; keep_waiting();)
+			{
+				if (RunPendingTask())
+					idle = 0;
+				else if (++idle < 64)
+					std::this_thread::yield();
+				else
+					std::this_thread::sleep_for(std::chrono::microseconds(50));
+			}
 		}
 
 		/*
 		* Adds tasks to the internal queue. If workers are available immediately the task will be executed
 		* If ready workers are not available, the tasks will be executed when any one worker thread is ready.
+		* In WorkStealing mode a task added from one of this pool's workers is pushed to that worker's local deque.
 		*
 		* Params:
-		* task_to_run - This is the task to be executed. Any callable of signature void() will be accepted
+		* task_to_run - This is the task to be executed. Any callable of signature void() will be accepted, move only ones too
 		* callback_when_complete - Calls this once the task is completed.
+		*
+		* The callables are moved into a recycled task record, small ones are stored inline (see ms::Task) so apart from
+		* the shared state of the returned future nothing is allocated per call.
 		* */
 		std::future<void> AddTaskForExecution(Task&& task_to_run, Task &&callback_when_complete = Task{})
 		{
-			// don't allow enqueueing after stopping the pool
-			if (cancel_flag)
-				throw std::runtime_error("enqueue on stopped WorkerPool");
-
-			std::promise<void> task_promise;
-			auto fut = task_promise.get_future();
-			std::unique_lock lk(tq_mx);
-			task_queue.emplace(std::make_tuple(task_to_run, callback_when_complete, std::move(task_promise)));
-			lk.unlock();
-			pull_task_signal->release();
+			auto record = MakeRecord(std::move(task_to_run), std::move(callback_when_complete));
+			auto fut = record->promise.emplace(MakePromise<void>()).get_future();
+			Enqueue(record);
 			return fut;
 		}
 
-	private:
-		std::vector<std::thread> _threads;
-		bool is_ready; //this is set thread safe using call_once
-		bool cancel_flag;
-		unsigned int capacity;
-		constexpr static size_t max_threads = 1'000;
-
-		void routine() noexcept;
+		/*
+		* Non blocking version of Post for pools with a bounded queue (PoolOptions::queue_capacity).
+		* Returns false, without waiting, if the queue is full. In that case the task is handed back through task_to_run
+		* so the caller can retry it later or drop it. With an unbounded queue it always succeeds.
+		* */
+		[[nodiscard]] bool TryPost(Task&& task_to_run, Task&& callback_when_complete = Task{})
+		{
+			auto record = MakeRecord(std::move(task_to_run), std::move(callback_when_complete));
+			if (bounded_queue && !(mode == SchedulerMode::WorkStealing && current_worker.pool == this))
+			{
+				auto now = std::chrono::steady_clock::now();
+				record->enqueued = now;
+				if (!bounded_queue->TryPush(record))
+				{
+					task_to_run = std::move(record->payload);
+					callback_when_complete = std::move(record->callback);
+					RecycleRecord(record);
+					return false;
+				}
+				CurrentCounters().submitted.fetch_add(1, std::memory_order_relaxed);
+				WORKERPOOL_TRACE(TracePoint::Enqueue, record, static_cast<unsigned int>(CurrentWorkerIndex()), now);
+				pull_task_signal->Release();
+				GrowIfBacklogged();
+				return true;
+			}
+			Enqueue(record);
+			return true;
+		}
 
-		std::queue<std::tuple<Task, Task, std::promise<void>>> task_queue;
-		std::mutex tq_mx;
+		/*
+		* Runs f(args...) on the pool and returns a handle to its result, f can return any type (or void).
+		* f and the arguments are forwarded into the task: rvalues are moved, nothing is copied twice, and they are
+		* handed to f as rvalues when it runs. The result is stored in the handle's recycled completion slot, inline
+		* up to CompletionState::result_size bytes, so with a small callable and result a warmed up pool allocates nothing.
+		* If f throws, the exception is rethrown from Get().
+		*
+		* Example: auto sum = pool.Submit([](int a, int b) { return a + b; }, 1, 2); sum.Get() == 3
+		* */
+		template <typename F, typename... Args, typename R = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>
+		[[nodiscard]] ResultHandle<R> Submit(F&& f, Args&&... args)
+		{
+			auto completion = AcquireCompletion(1);
+			ResultHandle<R> handle(completion);
+			TaskRecord* record = nullptr;
+			try
+			{
+				record = MakeRecord([completion, f = std::forward<F>(f), ...args = std::forward<Args>(args)]() mutable {
+					InvokeInto<R>(completion, f, args...);
+				}, Task{});
+			}
+			catch (...)
+			{
+				//the task's reference
+				completion->TaskFinished(std::current_exception(), CurrentCacheIndex());
+				throw;
+			}
+			record->completion = completion;
+			Enqueue(record);
+			return handle;
+		}
 
 		/*
-		* The use of ptr here:
-		* I was not able to use direct counting_semaphore as semaphore's copy ctor and copy assignment operators are deleted explicitly
+		* Fire and forget version of AddTaskForExecution. Nothing is returned, so there is no promise/future shared state to pay for,
+		* with a small callable the call does not allocate at all.
+		* Exceptions thrown by the task are swallowed, same as the ones from completion callbacks.
 		* */
-		std::unique_ptr<std::counting_semaphore<max_threads* max_threads>> pull_task_signal;
+		void Post(Task&& task_to_run, Task&& callback_when_complete = Task{})
+		{
+			auto record = MakeRecord(std::move(task_to_run), std::move(callback_when_complete));
+			Enqueue(record);
+		}
+
 		/*
-		* Not able to use condtion variable instead of semaphore for signalling the threads to pull tasks because of the lost wakeups
-		* because sometimes we can have in this order: task addition to queue and then waiting on cv
+		* Post for fork-join code. From one of this pool's workers the task goes to that worker's own deque whatever the
+		* scheduler mode: the worker picks its latest forks first when it helps (see HelpWhile) and idle workers steal the oldest.
+		* So helping goes depth first and a waiting worker's stack grows with the recursion depth, not with the queue length.
+		* From any other thread it is Post.
 		* */
-		std::once_flag _isready_onceflag;
-		std::atomic<int> available_workers;
-	};
+		void Fork(Task&& task_to_run)
+		{
+			auto record = MakeRecord(std::move(task_to_run), Task{});
+			Enqueue(record, current_worker.pool == this ? Placement::OwnDeque : Placement::Default);
+		}
 
-	void WorkerPool::routine() noexcept
-	{
-		std::call_once(_isready_onceflag, [](bool& is_ready) { is_ready = true;}, is_ready);
+		/*
+		* Post which queues the task at the back of the pool's shared queue, behind every task already waiting there, whatever the
+		* scheduler mode and the calling thread (Post from a worker of a WorkStealing pool pushes on its own deque, which it pops first).
+		* Meant for a task which gives its worker back after a slice of a long job and queues the rest of it, like Strand does:
+		* the tasks queued meanwhile run before the rest, the job doesn't keep the worker.
+		* */
+		void PostToBack(Task&& task_to_run)
+		{
+			auto record = MakeRecord(std::move(task_to_run), Task{});
+			Enqueue(record, Placement::Back);
+		}
 
-		while (!(cancel_flag && task_queue.empty()))
+		/*
+		* Schedules the drainer of a queue layered on the pool (Strand, ExecutorView): drain(budget) runs up to budget
+		* of the queue's tasks and calls ScheduleDrain again if some are left. It goes to the back of the shared queue
+		* (see PostToBack), if the pool is stopping the calling thread drains the whole queue instead.
+		* */
+		template <typename Drain>
+		void ScheduleDrain(size_t batch, Drain drain) noexcept
 		{
-			available_workers++;
 			try
 			{
-				if (!cancel_flag)
-				{
-					pull_task_signal->acquire();
-				}
+				PostToBack([drain, batch]() mutable { drain(batch); });
+			}
+			catch (...)
+			{
+				drain(static_cast<size_t>(-1));
+			}
+		}
 
-				std::unique_lock lk(tq_mx);
-				available_workers--;
-				if (task_queue.empty()) continue;
-				auto [payload, completion_callback, payload_promise] = std::exchange(task_queue.front(), {});
-				/*
-				The use of std::exchange ensures the task_queue's front element is accessed atomically and
-				any potential data races between threads accessing task_queue are avoided
-				*/
-
-				task_queue.pop();
-				lk.unlock();
+		/*
+		* Delayed and periodic tasks. A single timer thread, started with the first timer, keeps them in a hierarchical
+		* timer wheel (see TimerWheel) and posts each one to the pool when it is due: a pending timer holds no thread and
+		* adding or cancelling one is O(1), hundreds of thousands of them are fine. Due times are rounded up to
+		* PoolOptions::timer_resolution. Timers still pending when the pool is destroyed are dropped.
+		* */
+		TimerHandle AddTaskAt(std::chrono::steady_clock::time_point due, Task&& task_to_run)
+		{
+			return ArmTimer(due, 0, std::move(task_to_run));
+		}
+
+		template <typename Rep, typename Period>
+		TimerHandle AddTaskAfter(std::chrono::duration<Rep, Period> delay, Task&& task_to_run)
+		{
+			return ArmTimer(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay), 0, std::move(task_to_run));
+		}
+
+		/*
+		* Runs the task every period, the first time one period from now, until the timer is cancelled.
+		* Runs never overlap: the next one is scheduled once a run is over, a run late by more than a period skips the missed ones.
+		* Exceptions thrown by the task are swallowed.
+		* */
+		template <typename Rep, typename Period>
+		TimerHandle AddPeriodicTask(std::chrono::duration<Rep, Period> period, Task&& task_to_run)
+		{
+			auto ticks = std::max<int64_t>(1, (std::chrono::duration_cast<std::chrono::nanoseconds>(period).count() + timer_tick_ns - 1) / timer_tick_ns);
+			return ArmTimer(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(period), ticks, std::move(task_to_run));
+		}
+
+		/*
+		* Returns true if the timer won't run anymore because of this call: a pending one shot timer, or a periodic one
+		* (a run in progress completes). False if it has already run, is running (one shot) or was cancelled before.
+		* */
+		bool CancelTimer(const TimerHandle& timer) noexcept
+		{
+			if (!timer.entry)
+				return false;
+			std::unique_lock lk(timer_mx);
+			auto entry = timer.entry;
+			if (entry->id != timer.id)
+				return false;
+			if (entry->state == TimerEntry::State::Armed)
+			{
+				timer_wheel.Remove(entry);
+				ReleaseTimer(entry);
+				return true;
+			}
+			if (entry->state == TimerEntry::State::Running && entry->period != 0)
+			{
+				entry->state = TimerEntry::State::Cancelled;
+				return true;
+			}
+			return false;
+		}
+
+		//number of timers waiting in the wheel
+		[[nodiscard]] size_t PendingTimers()
+		{
+			std::unique_lock lk(timer_mx);
+			return timer_wheel.Size();
+		}
+
+		/*
+		* Same as Post, but returns a CompletionHandle which can be waited on.
+		* The handle is backed by a recycled pool owned slot instead of a std::future shared state.
+		* */
+		[[nodiscard]] CompletionHandle PostWithHandle(Task&& task_to_run, Task&& callback_when_complete = Task{})
+		{
+			auto record = MakeRecord(std::move(task_to_run), std::move(callback_when_complete));
+			record->completion = AcquireCompletion(1);
+			CompletionHandle handle(record->completion);
+			Enqueue(record);
+			return handle;
+		}
+
+		/*
+		* Awaitable which moves the awaiting coroutine onto a worker: co_await pool.Schedule();
+		* The coroutine handle itself is the queued task, it fits in the Task's inline storage so nothing is allocated
+		* besides the pool's recycled record. See Coroutines.hpp for task<T>, WhenAll and WhenAny.
+		* */
+		struct ScheduleAwaiter
+		{
+			WorkerPool& pool;
+
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> awaiting) { pool.Post(Task(awaiting)); }
+			void await_resume() const noexcept {}
+		};
+
+		[[nodiscard]] ScheduleAwaiter Schedule() noexcept { return ScheduleAwaiter{ *this }; }
+
+		/*
+		* Bulk version of PostWithHandle for fan-out code. All the tasks are published under a single lock of the global queue
+		* (or pushed straight to the local deque when called from a worker in WorkStealing mode) and the workers are signalled
+		* with one release(n), so at most min(n, idle workers) threads are woken up.
+		* Returns a single handle which completes when all the tasks have finished.
+		*
+		* tasks - any input range of callables of signature void(). The elements are moved out if the range is passed as an rvalue
+		* */
+		template <std::ranges::input_range Range>
+		[[nodiscard]] CompletionHandle AddTasksForExecution(Range&& tasks)
+		{
+			RecordChain chain(*this);
+			for (auto&& task : tasks)
+			{
+				if constexpr (std::is_lvalue_reference_v<Range>)
+					chain.Append(MakeRecord(Task(task), Task{}));
+				else
+					chain.Append(MakeRecord(Task(std::move(task)), Task{}));
+			}
+			return EnqueueBatch(chain);
+		}
+
+		/*
+		* Same as AddTasksForExecution but the tasks come from a generator, make_task(i) is called for i in [0, count)
+		* and has to return a callable of signature void(). Nothing is materialized in between.
+		* */
+		template <typename Generator>
+		[[nodiscard]] CompletionHandle SubmitBatch(size_t count, Generator&& make_task)
+		{
+			RecordChain chain(*this);
+			for (size_t i = 0; i < count; i++)
+			{
+				chain.Append(MakeRecord(Task(make_task(i)), Task{}));
+			}
+			return EnqueueBatch(chain);
+		}
+
+		/*
+		* Post/PostWithHandle into one of the priority lanes. Priority::Normal is the lane every other submission goes to.
+		* The high and background lanes are unbounded, PoolOptions::queue_capacity only applies to the normal one.
+		* */
+		void Post(Priority priority, Task&& task_to_run, Task&& callback_when_complete = Task{})
+		{
+			auto record = MakeRecord(std::move(task_to_run), std::move(callback_when_complete));
+			record->lane = static_cast<uint8_t>(priority);
+			Enqueue(record);
+		}
+
+		[[nodiscard]] CompletionHandle PostWithHandle(Priority priority, Task&& task_to_run, Task&& callback_when_complete = Task{})
+		{
+			auto record = MakeRecord(std::move(task_to_run), std::move(callback_when_complete));
+			record->lane = static_cast<uint8_t>(priority);
+			record->completion = AcquireCompletion(1);
+			CompletionHandle handle(record->completion);
+			Enqueue(record);
+			return handle;
+		}
+
+		/*
+		* Post/PostWithHandle to the workers of a NUMA node, node.index is taken modulo NodeCount().
+		* The task sits in the node's queue, where the node's workers look first, a remote worker only takes it when it would be idle otherwise.
+		* */
+		void Post(NumaNode node, Task&& task_to_run, Task&& callback_when_complete = Task{})
+		{
+			auto record = MakeRecord(std::move(task_to_run), std::move(callback_when_complete));
+			record->node = node.index;
+			Enqueue(record);
+		}
 
-				//execute the work assigned
-				payload();
+		[[nodiscard]] CompletionHandle PostWithHandle(NumaNode node, Task&& task_to_run, Task&& callback_when_complete = Task{})
+		{
+			auto record = MakeRecord(std::move(task_to_run), std::move(callback_when_complete));
+			record->node = node.index;
+			record->completion = AcquireCompletion(1);
+			CompletionHandle handle(record->completion);
+			Enqueue(record);
+			return handle;
+		}
+
+		/*
+		* Post/PostWithHandle with an absolute deadline. Tasks with a deadline are picked before any priority lane,
+		* earliest deadline first. The ones started after their deadline are counted in DeadlineMisses()
+		* */
+		void Post(std::chrono::steady_clock::time_point deadline, Task&& task_to_run, Task&& callback_when_complete = Task{})
+		{
+			auto record = MakeRecord(std::move(task_to_run), std::move(callback_when_complete));
+			record->lane = deadline_lane;
+			record->deadline = deadline;
+			Enqueue(record);
+		}
+
+		[[nodiscard]] CompletionHandle PostWithHandle(std::chrono::steady_clock::time_point deadline, Task&& task_to_run, Task&& callback_when_complete = Task{})
+		{
+			auto record = MakeRecord(std::move(task_to_run), std::move(callback_when_complete));
+			record->lane = deadline_lane;
+			record->deadline = deadline;
+			record->completion = AcquireCompletion(1);
+			CompletionHandle handle(record->completion);
+			Enqueue(record);
+			return handle;
+		}
+
+		/*
+		* Time the tasks of a lane spent queued, from submission to the start of their execution, summed over all the workers.
+		* Every worker records into its own histograms, reading them does not disturb the workers.
+		* */
+		[[nodiscard]] HistogramSnapshot QueueTimeStats(Priority priority) const noexcept
+		{
+			return CollectQueueTimes(static_cast<size_t>(priority));
+		}
 
-				payload_promise.set_value();
+		[[nodiscard]] HistogramSnapshot DeadlineQueueTimeStats() const noexcept
+		{
+			return CollectQueueTimes(deadline_lane);
+		}
 
-				//call the completion callback
-				completion_callback();
+		[[nodiscard]] uint64_t DeadlineMisses() const noexcept
+		{
+			auto misses = external_counters.deadline_misses.load(std::memory_order_relaxed);
+			for (const auto& worker : workers)
+			{
+				misses += worker->counters.deadline_misses.load(std::memory_order_relaxed);
 			}
-			catch (const std::exception& ex)
+			return misses;
+		}
+
+		/*
+		* Counters of the whole pool and of every worker slot. Every thread counts into its own cache line sized block
+		* (submitters which are not workers share one), so keeping them costs a few uncontended atomic adds and one clock read per task.
+		* */
+		[[nodiscard]] PoolStats Stats() const;
+
+	private:
+		//lanes of the records, the first three match Priority
+		static constexpr uint8_t high_lane = static_cast<uint8_t>(Priority::High);
+		static constexpr uint8_t normal_lane = static_cast<uint8_t>(Priority::Normal);
+		static constexpr uint8_t background_lane = static_cast<uint8_t>(Priority::Background);
+		static constexpr uint8_t deadline_lane = 3;
+		static constexpr size_t lane_count = 4;
+		static constexpr unsigned int no_node = ~0u;
+		static constexpr size_t max_dequeue_batch = 64;
+
+		struct TaskRecord
+		{
+			Task payload;
+			Task callback;
+			std::optional<std::promise<void>> promise;
+			CompletionState* completion = nullptr;
+			TaskRecord* next = nullptr; //links the records of a batch before they are published
+			uint8_t lane = normal_lane;
+			unsigned int node = no_node;
+			std::chrono::steady_clock::time_point enqueued;
+			std::chrono::steady_clock::time_point deadline;
+		};
+
+		/*
+		* Intrusive list of the records prepared for a batch, no allocation is needed to collect them.
+		* If building the batch throws, the records gathered so far go back to the free list
+		* */
+		struct RecordChain
+		{
+			explicit RecordChain(WorkerPool& pool) : pool(pool) {}
+			RecordChain(const RecordChain&) = delete;
+			RecordChain& operator = (const RecordChain&) = delete;
+			~RecordChain()
 			{
+				while (head)
+				{
+					pool.RecycleRecord(std::exchange(head, head->next));
+				}
+			}
 
+			void Append(TaskRecord* record) noexcept
+			{
+				*tail = record;
+				tail = &record->next;
+				count++;
 			}
+
+			WorkerPool& pool;
+			TaskRecord* head = nullptr;
+			TaskRecord** tail = &head;
+			size_t count = 0;
+		};
+
+		//written only by the thread they belong to (external_counters by any non worker thread), read by the stats getters
+		struct alignas(64) WorkerCounters
+		{
+			std::array<LatencyHistogram, lane_count> queue_time;
+			LatencyHistogram execution_time;
+			std::atomic<uint64_t> deadline_misses{ 0 };
+			std::atomic<uint64_t> submitted{ 0 };
+			std::atomic<uint64_t> started{ 0 };
+			std::atomic<uint64_t> completed{ 0 };
+			std::atomic<uint64_t> failed{ 0 };
+			std::atomic<int64_t> busy_ns{ 0 };
+			std::atomic<int64_t> idle_ns{ 0 };
+			//start of the current idle period, 0 while a task runs or when no thread is in the slot
+			std::atomic<int64_t> idle_since_ns{ 0 };
+		};
+
+		struct WorkerData
+		{
+			WorkStealingDeque<TaskRecord*> local_queue;
+			WorkerCounters counters;
+			std::atomic<bool> active{ false }; //a thread runs in this slot, cleared by the thread as the last thing before it leaves
+			unsigned int node = 0;
+			std::vector<unsigned int> cpus; //pinned to these when not empty
+			int64_t recent_task_ns = 0; //moving average of the execution time of the worker's tasks, owner only
+		};
+
+		//the high and background lanes and the per node queues, the normal lane is the global queue (task_queue or bounded_queue)
+		struct SharedQueue
+		{
+			std::mutex mx;
+			RingQueue<TaskRecord*> queue{ 64 };
+			std::atomic<size_t> size{ 0 };
+		};
+
+		/*
+		* Identifies the pool and the slot of the worker running on the current thread.
+		* Used to route submissions made from inside a task to the worker's own deque, zero initialized on every other thread
+		* */
+		struct WorkerContext
+		{
+			WorkerPool* pool;
+			unsigned int index;
+		};
+		static inline thread_local WorkerContext current_worker;
+
+		WorkerCounters& CurrentCounters() noexcept
+		{
+			return current_worker.pool == this ? workers[current_worker.index]->counters : external_counters;
+		}
+
+		size_t CurrentCacheIndex() const noexcept
+		{
+			return current_worker.pool == this ? current_worker.index : RecyclingPool<TaskRecord>::no_cache;
+		}
+
+		//the body of a Submit task: runs f(args...) and stores the result in the completion slot (the address for a reference)
+		template <typename R, typename F, typename... Args>
+		static void InvokeInto(CompletionState* completion, F& f, Args&... args)
+		{
+			using Stored = typename ResultHandle<R>::Stored;
+			if constexpr (std::is_void_v<R>)
+				std::invoke(std::move(f), std::move(args)...);
+			else if constexpr (std::is_reference_v<R>)
+				completion->template EmplaceResult<Stored>(&std::invoke(std::move(f), std::move(args)...));
+			else
+				completion->template EmplaceResult<Stored>(std::invoke(std::move(f), std::move(args)...));
+		}
+
+		//ExecutorView::Submit hands out the pool's completion slots too
+		friend class ExecutorView;
+
+		//the shared state comes from PoolOptions::memory_resource if one was given
+		template <typename R>
+		std::promise<R> MakePromise() const
+		{
+			if (memory_resource)
+				return std::promise<R>(std::allocator_arg, std::pmr::polymorphic_allocator<std::byte>(memory_resource));
+			return std::promise<R>();
+		}
+
+		TaskRecord* MakeRecord(Task&& task_to_run, Task&& callback_when_complete)
+		{
+			// don't allow enqueueing after stopping the pool
+			if (cancel_flag)
+				throw std::runtime_error("enqueue on stopped WorkerPool");
+			EnsureStarted();
+
+			auto record = records.Acquire(CurrentCacheIndex());
+			record->payload = std::move(task_to_run);
+			record->callback = std::move(callback_when_complete);
+			return record;
+		}
+
+		//the captures are destroyed right away, the record itself goes back to the free list
+		void RecycleRecord(TaskRecord* record) noexcept
+		{
+			record->payload.Reset();
+			record->callback.Reset();
+			record->promise.reset();
+			record->completion = nullptr;
+			record->next = nullptr;
+			record->lane = normal_lane;
+			record->node = no_node;
+			records.Release(record, CurrentCacheIndex());
+		}
+
+		//for a record which could not be queued, whoever waits on its completion is told about the failure
+		void AbandonRecord(TaskRecord* record, std::exception_ptr error) noexcept
+		{
+			if (record->completion)
+				record->completion->TaskFinished(error, CurrentCacheIndex());
+			RecycleRecord(record);
+		}
+
+		CompletionState* AcquireCompletion(uint32_t task_count)
+		{
+			auto state = completions.Acquire(CurrentCacheIndex());
+			state->Reset(task_count, &completions);
+			return state;
+		}
+
+		std::vector<ThreadCache::Thread> _threads; //one per slot, a retired thread is joined when its slot is reused
+		std::vector<std::unique_ptr<WorkerData>> workers;
+		std::atomic<bool> cancel_flag;
+		unsigned int capacity;
+		SchedulerMode mode;
+		constexpr static size_t thread_limit = 1'000;
+
+		static PoolOptions DefaultOptions(unsigned int capacity)
+		{
+			PoolOptions options;
+			options.capacity = capacity;
+			return options;
+		}
+
+		static unsigned int SlotCount(const PoolOptions& options) noexcept
+		{
+			return options.max_threads > 0 ? std::max(options.max_threads, options.capacity) : options.capacity;
+		}
+
+		//elastic sizing, see PoolOptions::max_threads and Resize
+		bool elastic;
+		size_t growth_backlog;
+		std::chrono::nanoseconds growth_wait;
+		std::chrono::nanoseconds idle_timeout;
+		std::atomic<unsigned int> min_threads{ 0 };
+		std::atomic<unsigned int> live_threads{ 0 };
+		std::atomic<unsigned int> retire_requests{ 0 };
+		std::mutex resize_mx; //serializes starting threads, Resize and the stop
+
+		//thread startup, see ThreadStart and WaitUntilReady
+		unsigned int initial_threads = 0;
+		bool reuse_threads = false;
+		std::atomic<bool> threads_started{ false };
+		std::atomic<uint32_t> starting_threads{ 0 }; //started but not waiting for tasks yet
+		/*
+		* Threads of a parallel start whose handle is not stored in _threads yet. They are stored by the threads
+		* which start them, so nothing may join or reuse a slot before this is back to 0.
+		* */
+		std::atomic<uint32_t> unstored_threads{ 0 };
+
+		static void CountDown(std::atomic<uint32_t>& counter, uint32_t count) noexcept
+		{
+			if (counter.fetch_sub(count, std::memory_order_acq_rel) == count)
+				counter.notify_all();
+		}
+
+		static void WaitForZero(const std::atomic<uint32_t>& counter) noexcept
+		{
+			for (auto p = counter.load(std::memory_order_acquire); p != 0; p = counter.load(std::memory_order_acquire))
+			{
+				counter.wait(p, std::memory_order_acquire);
+			}
+		}
+
+		void EnsureStarted()
+		{
+			if (threads_started.load(std::memory_order_acquire))
+				return;
+			std::unique_lock lk(resize_mx);
+			if (!threads_started.load(std::memory_order_relaxed) && !cancel_flag)
+				StartInitialThreads();
+		}
+
+		ThreadCache::Thread LaunchThread(unsigned int slot, unsigned int spawn_end)
+		{
+			if (reuse_threads && workers[slot]->cpus.empty())
+			{
+				return ThreadCache::Instance().Start([this, slot, spawn_end] {
+					routine(slot, spawn_end);
+					current_worker = {};
+				});
+			}
+			return ThreadCache::Thread(std::thread(&WorkerPool::routine, this, slot, spawn_end));
+		}
+
+		//resize_mx must be held. Reserves the first initial_threads slots and starts the first thread, which starts the others
+		void StartInitialThreads()
+		{
+			for (unsigned int slot = 0; slot < initial_threads; slot++)
+			{
+				workers[slot]->active.store(true, std::memory_order_relaxed);
+			}
+			live_threads.fetch_add(initial_threads);
+			starting_threads.fetch_add(initial_threads);
+			unstored_threads.fetch_add(initial_threads);
+			threads_started.store(true, std::memory_order_release);
+			try
+			{
+				_threads[0] = LaunchThread(0, initial_threads);
+			}
+			catch (...)
+			{
+				AbandonSlots(0, initial_threads);
+				threads_started.store(false, std::memory_order_release);
+				throw;
+			}
+			CountDown(unstored_threads, 1);
+		}
+
+		/*
+		* Run by the thread of slot first before it waits for tasks: starts the threads of the slots in (first, end),
+		* half of them at a time, every thread started gets the upper half of what is left to start.
+		* */
+		void StartSlots(unsigned int first, unsigned int end) noexcept
+		{
+			while (end - first > 1)
+			{
+				auto mid = first + (end - first + 1) / 2;
+				try
+				{
+					_threads[mid] = LaunchThread(mid, end);
+					CountDown(unstored_threads, 1);
+				}
+				catch (...)
+				{
+					//out of threads, the ones running will have to do
+					AbandonSlots(mid, end);
+				}
+				end = mid;
+			}
+		}
+
+		//gives back the reserved slots in [first, end) of a parallel start whose threads could not be started
+		void AbandonSlots(unsigned int first, unsigned int end) noexcept
+		{
+			for (unsigned int slot = first; slot < end; slot++)
+			{
+				live_threads.fetch_sub(1);
+				workers[slot]->active.store(false, std::memory_order_release);
+			}
+			CountDown(starting_threads, end - first);
+			CountDown(unstored_threads, end - first);
+		}
+
+		unsigned int FindFreeSlot() const noexcept
+		{
+			for (unsigned int slot = 0; slot < capacity; slot++)
+			{
+				if (!workers[slot]->active.load(std::memory_order_acquire))
+					return slot;
+			}
+			return capacity;
+		}
+
+		//resize_mx must be held
+		void StartWorker(unsigned int slot)
+		{
+			//the previous thread of the slot has cleared 'active' on its way out, the join returns right away
+			if (_threads[slot].joinable())
+				_threads[slot].join();
+
+			workers[slot]->active.store(true, std::memory_order_relaxed);
+			live_threads.fetch_add(1);
+			starting_threads.fetch_add(1);
+			try
+			{
+				_threads[slot] = LaunchThread(slot, slot + 1);
+			}
+			catch (...)
+			{
+				live_threads.fetch_sub(1);
+				workers[slot]->active.store(false, std::memory_order_release);
+				CountDown(starting_threads, 1);
+				throw;
+			}
+		}
+
+		bool TryConsumeRetireRequest() noexcept
+		{
+			auto requests = retire_requests.load();
+			while (requests > 0)
+			{
+				if (retire_requests.compare_exchange_weak(requests, requests - 1))
+					return true;
+			}
+			return false;
+		}
+
+		/*
+		* Called by the submitters, the workers and the growth watch when the pool looks overloaded. Never waits for resize_mx:
+		* if somebody else is resizing the pool right now, the growth watch tries again at its next check if tasks still wait
+		* */
+		void Grow() noexcept
+		{
+			std::unique_lock lk(resize_mx, std::try_to_lock);
+			//a parallel start in progress will take on the backlog too
+			if (!lk.owns_lock() || cancel_flag || live_threads.load() >= capacity || unstored_threads.load(std::memory_order_acquire) != 0)
+				return;
+
+			auto slot = FindFreeSlot();
+			if (slot == capacity)
+				return;
+			try
+			{
+				StartWorker(slot);
+			}
+			catch (...)
+			{
+				//out of threads, the ones running will get through the backlog
+			}
+		}
+
+		void GrowIfBacklogged() noexcept
+		{
+			if (!elastic || live_threads.load(std::memory_order_relaxed) >= capacity)
+				return;
+			if (available_workers.load(std::memory_order_relaxed) <= 0 && pull_task_signal->Pending() > static_cast<int64_t>(growth_backlog))
+				Grow();
+			//pairs with the fence of CheckGrowth: either the watch sees the task just queued or this sees the watch stopped
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!growth_watch.load(std::memory_order_relaxed))
+				WatchGrowth();
+		}
+
+		/*
+		* The submit and start triggers only fire when a task is queued or started. Once every worker is stuck in a long task
+		* nothing starts anymore, so while tasks are queued the timer thread checks every growth_wait that they move on.
+		* */
+		static constexpr unsigned int growth_watch_quiet_checks = 64; //checks with an empty queue before the watch stops
+		std::atomic<bool> growth_watch{ false };
+		uint64_t watched_started = 0; //written by the timer thread only
+		int64_t watched_pending = 0;
+		unsigned int quiet_checks = 0;
+
+		void WatchGrowth() noexcept;
+		bool CheckGrowth() noexcept;
+
+		bool WaitForTask(unsigned int index) noexcept;
+		void Retire(unsigned int index) noexcept;
+
+		//spawn_end - the thread starts the slots in (index, spawn_end) first, see StartSlots
+		void routine(unsigned int index, unsigned int spawn_end) noexcept;
+		/*
+		* Where Enqueue puts a task of the normal lane
+		* OwnDeque - a worker's submission which goes to its local deque in either mode (see Fork)
+		* Back - the global queue, even from a worker (see PostToBack)
+		* */
+		enum class Placement : uint8_t { Default, OwnDeque, Back };
+		void Enqueue(TaskRecord* record, Placement placement = Placement::Default);
+		bool PushBounded(TaskRecord* record);
+		void NotifyQueueSpace() noexcept;
+		CompletionHandle EnqueueBatch(RecordChain& chain);
+		TaskRecord* TryTakeTask(unsigned int index);
+		bool AllQueuesEmpty();
+		void Execute(TaskRecord* record) noexcept;
+		void EnqueuePrioritized(TaskRecord* record);
+		TaskRecord* PopLane(uint8_t lane);
+		TaskRecord* PopGlobalBatch(unsigned int index);
+		TaskRecord* TakeStarved(unsigned int index);
+		bool NormalLaneEmpty(int index) const noexcept;
+		HistogramSnapshot CollectQueueTimes(size_t lane) const noexcept;
+		void AddCounters(PoolStats& stats, const WorkerCounters& counters) const noexcept;
+
+		uint64_t StartedTasks() const noexcept
+		{
+			uint64_t started = external_counters.started.load(std::memory_order_relaxed);
+			for (const auto& worker : workers)
+			{
+				started += worker->counters.started.load(std::memory_order_relaxed);
+			}
+			return started;
+		}
+
+		static int64_t SinceEpochNs(std::chrono::steady_clock::time_point time) noexcept
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+		}
+
+		RingQueue<TaskRecord*> task_queue;
+		std::mutex tq_mx;
+		std::atomic<size_t> task_queue_size{ 0 }; //lets the workers skip tq_mx when there are no external submissions
+
+		//replaces task_queue when PoolOptions::queue_capacity is set
+		std::unique_ptr<BoundedMpmcQueue<TaskRecord*>> bounded_queue;
+		OverflowPolicy overflow_policy;
+		std::chrono::microseconds spin_timeout;
+		//producers blocked on a full bounded queue wait on space_epoch, which the workers bump only when someone is blocked
+		std::atomic<uint32_t> space_epoch{ 0 };
+		std::atomic<uint32_t> blocked_producers{ 0 };
+
+		SharedQueue high_queue;
+		SharedQueue background_queue;
+		//min heap on the deadline
+		std::vector<TaskRecord*> deadline_heap;
+		std::mutex deadline_mx;
+		std::atomic<size_t> deadline_size{ 0 };
+		std::atomic<size_t> prioritized_pending{ 0 }; //tasks in the high, background and deadline lanes, 0 keeps the workers on the plain path
+		/*
+		* Last time a worker picked a task from the lane, or the time work showed up in an empty lane.
+		* A lane holding work for longer than aging_threshold_ns since then is starved
+		* */
+		std::array<std::atomic<int64_t>, lane_count> lane_served_ns{};
+		int64_t aging_threshold_ns;
+		size_t dequeue_batch;
+		int64_t batch_task_ns;
+		WorkerCounters external_counters;
+
+		//one per node in a numa_aware pool on more than one node, empty otherwise
+		std::vector<std::unique_ptr<SharedQueue>> node_queues;
+		std::atomic<size_t> node_pending{ 0 };
+
+		void ConfigurePlacement(const PoolOptions& options)
+		{
+			//reading the machine's topology costs a scan of sysfs the first time, most pools need neither groups nor pinning
+			if (!options.numa_aware && (!options.pin_workers || !options.cpu_sets.empty()))
+			{
+				for (unsigned int i = 0; options.pin_workers && i < capacity; i++)
+					workers[i]->cpus = options.cpu_sets[i % options.cpu_sets.size()];
+				return;
+			}
+
+			auto topology = options.numa_nodes.empty() ? CpuTopology::System() : CpuTopology(options.numa_nodes);
+			auto node_count = options.numa_aware ? static_cast<unsigned int>(topology.NodeCount()) : 1u;
+			if (node_count > 1)
+			{
+				for (unsigned int node = 0; node < node_count; node++)
+					node_queues.emplace_back(std::make_unique<SharedQueue>());
+			}
+
+			std::vector<unsigned int> all_cpus;
+			for (size_t node = 0; node < topology.NodeCount(); node++)
+				all_cpus.insert(all_cpus.end(), topology.CpusOfNode(node).begin(), topology.CpusOfNode(node).end());
+
+			for (unsigned int i = 0; i < capacity; i++)
+			{
+				auto& worker = *workers[i];
+				worker.node = static_cast<unsigned int>(static_cast<unsigned long long>(i) * node_count / capacity);
+				if (!options.pin_workers)
+					continue;
+				if (!options.cpu_sets.empty())
+					worker.cpus = options.cpu_sets[i % options.cpu_sets.size()];
+				else if (options.numa_aware)
+					worker.cpus = topology.CpusOfNode(worker.node);
+				else
+					worker.cpus = { all_cpus[i % all_cpus.size()] };
+			}
+		}
+
+		TaskRecord* PopShared(SharedQueue& queue);
+		TaskRecord* PopNode(size_t node);
+
+		/*
+		* The use of ptr here:
+		* WorkSignal holds atomics and can't be copied or moved, same as the counting_semaphore it replaced
+		* */
+		std::unique_ptr<WorkSignal> pull_task_signal;
+		/*
+		* Not able to use condtion variable instead of semaphore for signalling the threads to pull tasks because of the lost wakeups
+		* because sometimes we can have in this order: task addition to queue and then waiting on cv.
+		* WorkSignal keeps the semaphore's token counting, so a release before the wait is never lost
+		* */
+		std::atomic<int> available_workers;
+
+		std::pmr::memory_resource* memory_resource; //nullptr for the heap
+		RecyclingPool<TaskRecord> records;
+		RecyclingPool<CompletionState> completions;
+
+		//timers, everything below is guarded by timer_mx
+		std::mutex timer_mx;
+		std::condition_variable timer_cv;
+		std::thread timer_thread;
+		bool timers_stopped = false;
+		std::chrono::steady_clock::time_point next_growth_check;
+		TimerWheel timer_wheel;
+		RecyclingPool<TimerEntry> timer_entries;
+		std::chrono::steady_clock::time_point timer_origin = std::chrono::steady_clock::now();
+		int64_t timer_tick_ns;
+		uint64_t timer_ids = 0;
+
+		//tick of a due time, rounded up so that a timer never runs early
+		int64_t TickOf(std::chrono::steady_clock::time_point time) const noexcept
+		{
+			auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time - timer_origin).count();
+			return ns > 0 ? (ns + timer_tick_ns - 1) / timer_tick_ns : 0;
+		}
+
+		std::chrono::steady_clock::time_point TimeOfTick(int64_t tick) const noexcept
+		{
+			return timer_origin + std::chrono::nanoseconds(tick * timer_tick_ns);
+		}
+
+		TimerHandle ArmTimer(std::chrono::steady_clock::time_point due, int64_t period, Task&& task_to_run);
+		void ReleaseTimer(TimerEntry* entry) noexcept;
+		void RunPeriodic(TimerEntry* entry) noexcept;
+		void TimerRoutine() noexcept;
+		void StopTimers() noexcept;
+	};
+
+	inline void WorkerPool::Enqueue(TaskRecord* record, Placement placement)
+	{
+		auto now = std::chrono::steady_clock::now();
+		record->enqueued = now;
+		CurrentCounters().submitted.fetch_add(1, std::memory_order_relaxed);
+		WORKERPOOL_TRACE(TracePoint::Enqueue, record, static_cast<unsigned int>(CurrentWorkerIndex()), now);
+		if (record->lane != normal_lane)
+		{
+			EnqueuePrioritized(record);
+			return;
+		}
+
+		//starts the aging clock of the normal lane when work shows up in it
+		if (NormalLaneEmpty(CurrentWorkerIndex()))
+			lane_served_ns[normal_lane].store(SinceEpochNs(now), std::memory_order_relaxed);
+
+		auto is_worker = current_worker.pool == this;
+		if (placement == Placement::OwnDeque)
+		{
+			workers[current_worker.index]->local_queue.Push(record);
+		}
+		else if (!node_queues.empty() && (record->node != no_node || (is_worker && mode == SchedulerMode::GlobalQueue && placement == Placement::Default)))
+		{
+			//a node hint, or a worker's submission which stays on its node
+			auto node = record->node != no_node ? record->node % node_queues.size() : workers[current_worker.index]->node;
+			auto& queue = *node_queues[node];
+			std::unique_lock lk(queue.mx);
+			queue.queue.Push(record);
+			queue.size.fetch_add(1, std::memory_order_relaxed);
+			node_pending.fetch_add(1, std::memory_order_relaxed);
+		}
+		else if (mode == SchedulerMode::WorkStealing && is_worker && placement == Placement::Default)
+		{
+			workers[current_worker.index]->local_queue.Push(record);
+		}
+		else if (bounded_queue)
+		{
+			if (!PushBounded(record))
+				return; //already executed
+		}
+		else
+		{
+			std::unique_lock lk(tq_mx);
+			task_queue.Push(record);
+			task_queue_size.fetch_add(1, std::memory_order_relaxed);
+		}
+		//one release per task, a worker which acquires the signal is guaranteed to find a task in one of the queues
+		pull_task_signal->Release();
+		GrowIfBacklogged();
+	}
+
+	inline void WorkerPool::EnqueuePrioritized(TaskRecord* record)
+	{
+		auto now_ns = SinceEpochNs(record->enqueued);
+		if (record->lane == deadline_lane)
+		{
+			std::unique_lock lk(deadline_mx);
+			deadline_heap.push_back(record);
+			std::push_heap(deadline_heap.begin(), deadline_heap.end(), [](TaskRecord* a, TaskRecord* b) { return a->deadline > b->deadline; });
+			deadline_size.fetch_add(1, std::memory_order_relaxed);
+		}
+		else
+		{
+			auto& lane = record->lane == high_lane ? high_queue : background_queue;
+			std::unique_lock lk(lane.mx);
+			if (lane.queue.Empty())
+				lane_served_ns[record->lane].store(now_ns, std::memory_order_relaxed);
+			lane.queue.Push(record);
+			lane.size.fetch_add(1, std::memory_order_relaxed);
+		}
+		prioritized_pending.fetch_add(1, std::memory_order_relaxed);
+		pull_task_signal->Release();
+		GrowIfBacklogged();
+	}
+
+	/*
+	* Pushes to the bounded queue applying the overflow policy. Returns false if the queue was full and the caller, being one
+	* of the pool's workers, has run the task inline instead of waiting (all the workers blocking on a full queue would never wake up).
+	* Throws if the spin timeout expires, the record is abandoned in that case.
+	* */
+	inline bool WorkerPool::PushBounded(TaskRecord* record)
+	{
+		if (bounded_queue->TryPush(record))
+			return true;
+
+		if (current_worker.pool == this)
+		{
+			Execute(record);
+			return false;
+		}
+
+		if (overflow_policy == OverflowPolicy::SpinWithTimeout)
+		{
+			auto deadline = std::chrono::steady_clock::now() + spin_timeout;
+			while (!bounded_queue->TryPush(record))
+			{
+				if (std::chrono::steady_clock::now() >= deadline)
+				{
+					auto error = std::make_exception_ptr(std::runtime_error("WorkerPool queue is full"));
+					//counted by Enqueue, but never queued
+					CurrentCounters().submitted.fetch_sub(1, std::memory_order_relaxed);
+					AbandonRecord(record, error);
+					std::rethrow_exception(error);
+				}
+				std::this_thread::yield();
+			}
+			return true;
+		}
+
+		blocked_producers.fetch_add(1, std::memory_order_seq_cst);
+		while (true)
+		{
+			auto epoch = space_epoch.load(std::memory_order_seq_cst);
+			if (bounded_queue->TryPush(record))
+				break;
+			space_epoch.wait(epoch, std::memory_order_seq_cst);
+		}
+		blocked_producers.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	inline void WorkerPool::NotifyQueueSpace() noexcept
+	{
+		//pairs with the seq_cst increment of blocked_producers, either the producer sees the free cell or we see the producer
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (blocked_producers.load(std::memory_order_relaxed) > 0)
+		{
+			space_epoch.fetch_add(1, std::memory_order_seq_cst);
+			space_epoch.notify_all();
+		}
+	}
+
+	inline CompletionHandle WorkerPool::EnqueueBatch(RecordChain& chain)
+	{
+		auto count = chain.count;
+		auto state = AcquireCompletion(static_cast<uint32_t>(count));
+		CompletionHandle handle(state);
+		if (count == 0)
+		{
+			//nothing will ever finish, drop the tasks' reference right away
+			state->Unref(CurrentCacheIndex());
+			return handle;
+		}
+
+		//the chain is consumed, from here on the records belong to the queues
+		CurrentCounters().submitted.fetch_add(count, std::memory_order_relaxed);
+		auto record = std::exchange(chain.head, nullptr);
+		auto now = std::chrono::steady_clock::now();
+		auto publish = [&](auto push) {
+			while (record)
+			{
+				auto next = std::exchange(record->next, nullptr);
+				record->completion = state;
+				record->enqueued = now;
+				WORKERPOOL_TRACE(TracePoint::Enqueue, record, static_cast<unsigned int>(CurrentWorkerIndex()), now);
+				push(record);
+				record = next;
+			}
+		};
+
+		if (mode == SchedulerMode::WorkStealing && current_worker.pool == this)
+		{
+			auto& local_queue = workers[current_worker.index]->local_queue;
+			publish([&](TaskRecord* r) { local_queue.Push(r); });
+		}
+		else if (bounded_queue)
+		{
+			/*
+			* No single critical section here, every record takes its own cell and may have to wait for room,
+			* so each one is signalled right away: the workers must be able to drain what is queued meanwhile
+			* */
+			while (record)
+			{
+				auto next = std::exchange(record->next, nullptr);
+				record->completion = state;
+				record->enqueued = now;
+				WORKERPOOL_TRACE(TracePoint::Enqueue, record, static_cast<unsigned int>(CurrentWorkerIndex()), now);
+				try
+				{
+					if (PushBounded(record))
+						pull_task_signal->Release();
+				}
+				catch (...)
+				{
+					//the failed record has been abandoned already, the ones behind it were never published
+					auto error = std::current_exception();
+					for (record = next; record; record = next)
+					{
+						next = std::exchange(record->next, nullptr);
+						record->completion = state;
+						CurrentCounters().submitted.fetch_sub(1, std::memory_order_relaxed);
+						AbandonRecord(record, error);
+					}
+					throw;
+				}
+				record = next;
+			}
+			GrowIfBacklogged();
+			return handle;
+		}
+		else
+		{
+			std::unique_lock lk(tq_mx);
+			task_queue.Reserve(task_queue.Size() + count);
+			publish([&](TaskRecord* r) { task_queue.Push(r); });
+			task_queue_size.fetch_add(count, std::memory_order_relaxed);
+		}
+		pull_task_signal->Release(static_cast<int64_t>(count));
+		GrowIfBacklogged();
+		return handle;
+	}
+
+	/*
+	* Picks the most urgent task available to the worker: a starved lane first (see Priority), then the earliest deadline,
+	* the high lane, the worker's own deque and the normal lane, the background lane and finally the other workers' deques.
+	* While no prioritized task is queued this is the plain local deque -> global queue -> steal path.
+	* */
+	inline WorkerPool::TaskRecord* WorkerPool::TryTakeTask(unsigned int index)
+	{
+		auto prioritized = prioritized_pending.load(std::memory_order_relaxed) > 0;
+		if (prioritized)
+		{
+			if (auto record = TakeStarved(index))
+				return record;
+			if (auto record = PopLane(deadline_lane))
+				return record;
+			if (auto record = PopLane(high_lane))
+				return record;
+		}
+
+		//in GlobalQueue mode the deque only holds what the worker moved there from the global queue
+		auto& worker = *workers[index];
+		if (auto own = worker.local_queue.Pop())
+			return *own;
+
+		auto remote_nodes = node_pending.load(std::memory_order_relaxed) > 0;
+		if (remote_nodes)
+		{
+			if (auto record = PopNode(worker.node))
+				return record;
+		}
+
+		if (auto record = PopGlobalBatch(index))
+			return record;
+
+		if (prioritized)
+		{
+			if (auto record = PopLane(background_lane))
+				return record;
+		}
+
+		/*
+		* Stealing prefers the worker's own node: its deques first, then the queues of the other nodes and last their deques.
+		* Start from the next worker so that the thieves don't all hammer the first deque. Both modes steal, batched dequeues
+		* leave tasks in the deques of GlobalQueue workers too
+		* */
+		auto steal = [&](bool same_node) -> TaskRecord* {
+			for (size_t i = 1; i < workers.size(); i++)
+			{
+				auto& victim = *workers[(index + i) % workers.size()];
+				if ((victim.node == worker.node) != same_node)
+					continue;
+				if (auto stolen = victim.local_queue.Steal())
+					return *stolen;
+			}
+			return nullptr;
+		};
+
+		if (auto stolen = steal(true))
+			return stolen;
+
+		if (!node_queues.empty())
+		{
+			for (size_t i = 1; remote_nodes && i < node_queues.size(); i++)
+			{
+				if (auto record = PopNode((worker.node + i) % node_queues.size()))
+					return record;
+			}
+			return steal(false);
+		}
+		return nullptr;
+	}
+
+	inline WorkerPool::TaskRecord* WorkerPool::PopShared(SharedQueue& queue)
+	{
+		if (queue.size.load(std::memory_order_relaxed) == 0)
+			return nullptr;
+		std::unique_lock lk(queue.mx);
+		if (queue.queue.Empty())
+			return nullptr;
+		auto record = queue.queue.Pop();
+		queue.size.fetch_sub(1, std::memory_order_relaxed);
+		return record;
+	}
+
+	inline WorkerPool::TaskRecord* WorkerPool::PopNode(size_t node)
+	{
+		auto record = PopShared(*node_queues[node]);
+		if (record)
+			node_pending.fetch_sub(1, std::memory_order_relaxed);
+		return record;
+	}
+
+	//pops from the shared queue of the lane, the normal lane's being the global queue
+	/*
+	* Normal lane pop of a worker. From the unbounded global queue it takes a batch in one lock: the oldest task is returned and
+	* the others go to the worker's deque, the tokens standing for them stay with the queue so idle workers still come and steal them.
+	* */
+	inline WorkerPool::TaskRecord* WorkerPool::PopGlobalBatch(unsigned int index)
+	{
+		if (bounded_queue || dequeue_batch == 1)
+			return PopLane(normal_lane);
+		if (task_queue_size.load(std::memory_order_relaxed) == 0)
+			return nullptr;
+
+		auto& worker = *workers[index];
+		std::array<TaskRecord*, max_dequeue_batch> batch;
+		size_t count = 0;
+		{
+			std::unique_lock lk(tq_mx);
+			auto queued = task_queue.Size();
+			if (queued == 0)
+				return nullptr;
+			count = 1;
+			if (worker.recent_task_ns < batch_task_ns)
+				count = std::clamp<size_t>(queued / std::max(live_threads.load(std::memory_order_relaxed), 1u), 1, dequeue_batch);
+			for (size_t i = 0; i < count; i++)
+				batch[i] = task_queue.Pop();
+			task_queue_size.fetch_sub(count, std::memory_order_relaxed);
+		}
+
+		//newest first, the owner pops from the same end so it keeps running them in submission order
+		for (size_t i = count - 1; i > 0; i--)
+			worker.local_queue.Push(batch[i]);
+		return batch[0];
+	}
+
+	inline WorkerPool::TaskRecord* WorkerPool::PopLane(uint8_t lane)
+	{
+		if (lane == normal_lane)
+		{
+			if (bounded_queue)
+			{
+				if (auto record = bounded_queue->TryPop())
+				{
+					NotifyQueueSpace();
+					return *record;
+				}
+			}
+			else if (task_queue_size.load(std::memory_order_relaxed) > 0)
+			{
+				std::unique_lock lk(tq_mx);
+				if (!task_queue.Empty())
+				{
+					auto record = task_queue.Pop();
+					task_queue_size.fetch_sub(1, std::memory_order_relaxed);
+					return record;
+				}
+			}
+			return nullptr;
+		}
+
+		TaskRecord* record = nullptr;
+		if (lane == deadline_lane)
+		{
+			if (deadline_size.load(std::memory_order_relaxed) == 0)
+				return nullptr;
+			std::unique_lock lk(deadline_mx);
+			if (deadline_heap.empty())
+				return nullptr;
+			std::pop_heap(deadline_heap.begin(), deadline_heap.end(), [](TaskRecord* a, TaskRecord* b) { return a->deadline > b->deadline; });
+			record = deadline_heap.back();
+			deadline_heap.pop_back();
+			deadline_size.fetch_sub(1, std::memory_order_relaxed);
+		}
+		else
+		{
+			record = PopShared(lane == high_lane ? high_queue : background_queue);
+			if (!record)
+				return nullptr;
+		}
+		prioritized_pending.fetch_sub(1, std::memory_order_relaxed);
+		return record;
+	}
+
+	//anti-starvation aging, the lowest lane which has had work waiting for longer than the aging threshold is served first
+	inline WorkerPool::TaskRecord* WorkerPool::TakeStarved(unsigned int index)
+	{
+		auto now = SinceEpochNs(std::chrono::steady_clock::now());
+		auto starved = [&](uint8_t lane) { return now - lane_served_ns[lane].load(std::memory_order_relaxed) > aging_threshold_ns; };
+
+		if (background_queue.size.load(std::memory_order_relaxed) > 0 && starved(background_lane))
+		{
+			if (auto record = PopLane(background_lane))
+				return record;
+		}
+		if (!NormalLaneEmpty(static_cast<int>(index)) && starved(normal_lane))
+		{
+			if (auto own = workers[index]->local_queue.Pop())
+				return *own;
+			if (!node_queues.empty())
+			{
+				if (auto record = PopNode(workers[index]->node))
+					return record;
+			}
+			if (auto record = PopLane(normal_lane))
+				return record;
+		}
+		if (high_queue.size.load(std::memory_order_relaxed) > 0 && starved(high_lane))
+			return PopLane(high_lane);
+		return nullptr;
+	}
+
+	//index of the worker whose local deque counts as part of the lane, -1 for the global queue only
+	inline bool WorkerPool::NormalLaneEmpty(int index) const noexcept
+	{
+		if (task_queue_size.load(std::memory_order_relaxed) > 0 || (bounded_queue && !bounded_queue->Empty()) || node_pending.load(std::memory_order_relaxed) > 0)
+			return false;
+		return index < 0 || workers[index]->local_queue.Empty();
+	}
+
+	inline bool WorkerPool::AllQueuesEmpty()
+	{
+		if (task_queue_size.load(std::memory_order_acquire) > 0 || (bounded_queue && !bounded_queue->Empty()) || prioritized_pending.load(std::memory_order_acquire) > 0
+			|| node_pending.load(std::memory_order_acquire) > 0)
+			return false;
+		return std::all_of(workers.begin(), workers.end(), [](const auto& w) { return w->local_queue.Empty(); });
+	}
+
+	inline HistogramSnapshot WorkerPool::CollectQueueTimes(size_t lane) const noexcept
+	{
+		auto snapshot = external_counters.queue_time[lane].Snapshot();
+		for (const auto& worker : workers)
+		{
+			snapshot += worker->counters.queue_time[lane].Snapshot();
+		}
+		return snapshot;
+	}
+
+	inline void WorkerPool::AddCounters(PoolStats& stats, const WorkerCounters& counters) const noexcept
+	{
+		stats.tasks_submitted += counters.submitted.load(std::memory_order_relaxed);
+		stats.tasks_completed += counters.completed.load(std::memory_order_relaxed);
+		stats.tasks_failed += counters.failed.load(std::memory_order_relaxed);
+		for (const auto& lane : counters.queue_time)
+		{
+			stats.queue_time += lane.Snapshot();
+		}
+		stats.execution_time += counters.execution_time.Snapshot();
+	}
+
+	inline PoolStats WorkerPool::Stats() const
+	{
+		PoolStats stats;
+		stats.threads = ThreadCount();
+		stats.workers.resize(workers.size());
+		auto now_ns = SinceEpochNs(std::chrono::steady_clock::now());
+		AddCounters(stats, external_counters);
+		for (size_t i = 0; i < workers.size(); i++)
+		{
+			const auto& counters = workers[i]->counters;
+			AddCounters(stats, counters);
+			auto& worker = stats.workers[i];
+			auto idle_since_ns = counters.idle_since_ns.load(std::memory_order_relaxed);
+			worker.running = workers[i]->active.load(std::memory_order_acquire);
+			worker.idle = worker.running && idle_since_ns != 0;
+			worker.tasks_executed = counters.completed.load(std::memory_order_relaxed);
+			worker.busy_time = std::chrono::nanoseconds(counters.busy_ns.load(std::memory_order_relaxed));
+			worker.idle_time = std::chrono::nanoseconds(counters.idle_ns.load(std::memory_order_relaxed) + (idle_since_ns != 0 ? std::max<int64_t>(now_ns - idle_since_ns, 0) : 0));
+		}
+
+		//read after the submissions, so the tasks moving on meanwhile can't make the queue look deeper than it was
+		auto started = StartedTasks();
+		stats.queue_depth = stats.tasks_submitted > started ? static_cast<size_t>(stats.tasks_submitted - started) : 0;
+		stats.tasks_running = started > stats.tasks_completed ? static_cast<size_t>(started - stats.tasks_completed) : 0;
+		return stats;
+	}
+
+	inline void WorkerPool::Execute(TaskRecord* record) noexcept
+	{
+		auto started = std::chrono::steady_clock::now();
+		auto started_ns = SinceEpochNs(started);
+		auto& counters = CurrentCounters();
+		WORKERPOOL_TRACE(TracePoint::Start, record, static_cast<unsigned int>(CurrentWorkerIndex()), started);
+		counters.started.fetch_add(1, std::memory_order_relaxed);
+		counters.queue_time[record->lane].Record(started - record->enqueued);
+		//a worker's idle period ends here, unless this task runs inline inside another one
+		auto idle_since_ns = counters.idle_since_ns.load(std::memory_order_relaxed);
+		if (idle_since_ns != 0)
+		{
+			counters.idle_ns.fetch_add(started_ns - idle_since_ns, std::memory_order_relaxed);
+			counters.idle_since_ns.store(0, std::memory_order_relaxed);
+		}
+		if (record->lane == deadline_lane && started > record->deadline)
+			counters.deadline_misses.fetch_add(1, std::memory_order_relaxed);
+		//the aging clock of a busy lane is refreshed once in a while rather than on every task, it is shared by all the workers
+		auto& served = lane_served_ns[record->lane];
+		if (started_ns - served.load(std::memory_order_relaxed) > aging_threshold_ns / 8)
+			served.store(started_ns, std::memory_order_relaxed);
+
+		//the other growth trigger, next to the backlog one checked by the submitters
+		if (elastic && started - record->enqueued > growth_wait && available_workers.load(std::memory_order_relaxed) <= 0 && pull_task_signal->Pending() > 0)
+			Grow();
+
+		std::exception_ptr error;
+		try
+		{
+			//execute the work assigned
+			record->payload();
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+
+		//a failed task reports its exception through the future instead of leaving it broken
+		if (record->promise)
+		{
+			if (error)
+				record->promise->set_exception(error);
+			else
+				record->promise->set_value();
+		}
+
+		if (record->completion)
+			record->completion->TaskFinished(error, CurrentCacheIndex());
+
+		try
+		{
+			//call the completion callback
+			if (!error && record->callback)
+				record->callback();
+		}
+		catch (...)
+		{
+
+		}
+
+		auto finished = std::chrono::steady_clock::now();
+		counters.execution_time.Record(finished - started);
+		if (error)
+			counters.failed.fetch_add(1, std::memory_order_relaxed);
+		counters.completed.fetch_add(1, std::memory_order_relaxed);
+		if (current_worker.pool == this)
+		{
+			auto& recent = workers[current_worker.index]->recent_task_ns;
+			recent += (std::chrono::duration_cast<std::chrono::nanoseconds>(finished - started).count() - recent) / 8;
+		}
+		if (idle_since_ns != 0)
+		{
+			auto finished_ns = SinceEpochNs(finished);
+			counters.busy_ns.fetch_add(finished_ns - started_ns, std::memory_order_relaxed);
+			counters.idle_since_ns.store(finished_ns, std::memory_order_relaxed);
+		}
+		WORKERPOOL_TRACE(TracePoint::Finish, record, static_cast<unsigned int>(CurrentWorkerIndex()), finished);
+
+		RecycleRecord(record);
+	}
+
+	/*
+	* Waits for a token. Returns false if the worker has to leave instead: it took a token standing for a Resize retirement,
+	* or, in an elastic pool, it sat idle for idle_timeout while more than min_threads threads are running.
+	* */
+	inline bool WorkerPool::WaitForTask(unsigned int index) noexcept
+	{
+		while (true)
+		{
+			if (!elastic)
+			{
+				pull_task_signal->Acquire();
+			}
+			else if (!pull_task_signal->AcquireFor(idle_timeout))
+			{
+				auto live = live_threads.load();
+				while (live > min_threads.load())
+				{
+					if (live_threads.compare_exchange_weak(live, live - 1))
+					{
+						Retire(index);
+						return false;
+					}
+				}
+				continue;
+			}
+
+			if (TryConsumeRetireRequest())
+			{
+				live_threads.fetch_sub(1);
+				Retire(index);
+				return false;
+			}
+			return true;
+		}
+	}
+
+	//live_threads is already decremented, gives the slot back
+	inline void WorkerPool::Retire(unsigned int index) noexcept
+	{
+		auto& counters = workers[index]->counters;
+		if (auto idle_since_ns = counters.idle_since_ns.exchange(0, std::memory_order_relaxed); idle_since_ns != 0)
+			counters.idle_ns.fetch_add(SinceEpochNs(std::chrono::steady_clock::now()) - idle_since_ns, std::memory_order_relaxed);
+		current_worker = {};
+		workers[index]->active.store(false, std::memory_order_release);
+	}
+
+	inline TimerHandle WorkerPool::ArmTimer(std::chrono::steady_clock::time_point due, int64_t period, Task&& task_to_run)
+	{
+		std::unique_lock lk(timer_mx);
+		if (timers_stopped || cancel_flag)
+			throw std::runtime_error("timer on stopped WorkerPool");
+
+		auto entry = timer_entries.Acquire(RecyclingPool<TimerEntry>::no_cache);
+		entry->due = TickOf(due);
+		entry->period = period;
+		entry->id = ++timer_ids;
+		entry->state = TimerEntry::State::Armed;
+		auto earliest = entry->due < timer_wheel.NextEventTick();
+		timer_wheel.Insert(entry);
+
+		if (!timer_thread.joinable())
+		{
+			try
+			{
+				timer_thread = std::thread(&WorkerPool::TimerRoutine, this);
+			}
+			catch (...)
+			{
+				timer_wheel.Remove(entry);
+				ReleaseTimer(entry);
+				throw;
+			}
+		}
+		else if (earliest)
+		{
+			timer_cv.notify_one();
+		}
+		//nothing can throw anymore
+		entry->task = std::move(task_to_run);
+		return { entry, entry->id };
+	}
+
+	//timer_mx is held
+	inline void WorkerPool::ReleaseTimer(TimerEntry* entry) noexcept
+	{
+		entry->task.Reset();
+		entry->next = nullptr;
+		entry->state = TimerEntry::State::Free;
+		timer_entries.Release(entry, RecyclingPool<TimerEntry>::no_cache);
+	}
+
+	inline void WorkerPool::RunPeriodic(TimerEntry* entry) noexcept
+	{
+		try
+		{
+			entry->task();
+		}
+		catch (...)
+		{
+
+		}
+
+		std::unique_lock lk(timer_mx);
+		if (entry->state == TimerEntry::State::Cancelled || timers_stopped)
+		{
+			ReleaseTimer(entry);
+			return;
+		}
+		auto now = TickOf(std::chrono::steady_clock::now());
+		entry->due += entry->period;
+		if (entry->due < now)
+			entry->due += (now - entry->due + entry->period - 1) / entry->period * entry->period;
+		entry->state = TimerEntry::State::Armed;
+		auto earliest = entry->due < timer_wheel.NextEventTick();
+		timer_wheel.Insert(entry);
+		if (earliest)
+			timer_cv.notify_one();
+	}
+
+	/*
+	* The timer thread only moves the wheel forward and posts what is due, the tasks run on the workers.
+	* It sleeps until the next tick where the wheel has something to do, or until an earlier timer is added.
+	* Due timers are posted without holding timer_mx: a submission can wait on a full bounded queue.
+	* */
+	inline void WorkerPool::TimerRoutine() noexcept
+	{
+		std::unique_lock lk(timer_mx);
+		while (!timers_stopped)
+		{
+			auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - timer_origin).count();
+			TimerEntry* fired = nullptr;
+			auto tail = &fired;
+			timer_wheel.Advance(elapsed / timer_tick_ns, [&tail](TimerEntry* entry) {
+				entry->state = TimerEntry::State::Running;
+				*tail = entry;
+				tail = &entry->next;
+			});
+
+			if (fired)
+			{
+				//one shot timers, and periodic ones which could not be posted, go back to the free list afterwards
+				TimerEntry* over = nullptr;
+				lk.unlock();
+				while (fired)
+				{
+					auto entry = std::exchange(fired, fired->next);
+					auto one_shot = entry->period == 0;
+					try
+					{
+						if (one_shot)
+							Post(std::move(entry->task));
+						else
+							Post([this, entry] { RunPeriodic(entry); });
+					}
+					catch (...)
+					{
+						//the pool is stopping
+						one_shot = true;
+					}
+					if (one_shot)
+						entry->next = std::exchange(over, entry);
+				}
+				lk.lock();
+				while (over)
+					ReleaseTimer(std::exchange(over, over->next));
+				continue;
+			}
+
+			auto next = timer_wheel.NextEventTick();
+			auto wake = next == TimerWheel::no_event ? std::chrono::steady_clock::time_point::max() : TimeOfTick(next);
+			if (growth_watch.load(std::memory_order_relaxed))
+			{
+				auto now = std::chrono::steady_clock::now();
+				if (now >= next_growth_check)
+				{
+					next_growth_check = now + std::max<std::chrono::nanoseconds>(growth_wait, std::chrono::microseconds(100));
+					lk.unlock();
+					CheckGrowth();
+					lk.lock();
+					continue;
+				}
+				wake = std::min(wake, next_growth_check);
+			}
+			if (wake == std::chrono::steady_clock::time_point::max())
+				timer_cv.wait(lk);
+			else
+				timer_cv.wait_until(lk, wake);
+		}
+	}
+
+	//starts the growth checks of the timer thread, which is started too if no timer did it yet
+	inline void WorkerPool::WatchGrowth() noexcept
+	{
+		std::unique_lock lk(timer_mx);
+		if (timers_stopped || growth_watch.load(std::memory_order_relaxed))
+			return;
+		if (!timer_thread.joinable())
+		{
+			try
+			{
+				timer_thread = std::thread(&WorkerPool::TimerRoutine, this);
+			}
+			catch (...)
+			{
+				//out of threads, the submit and start triggers will have to do
+				return;
+			}
+		}
+		growth_watch.store(true, std::memory_order_relaxed);
+		next_growth_check = std::chrono::steady_clock::now() + std::max<std::chrono::nanoseconds>(growth_wait, std::chrono::microseconds(100));
+		timer_cv.notify_one();
+	}
+
+	/*
+	* Run by the timer thread. If fewer tasks started since the previous check than were queued then, one of those
+	* is still queued and has waited for growth_wait at least, whatever order the queues are served in.
+	* Returns false, the watch stopped, once the queue has been empty for growth_watch_quiet_checks checks.
+	* */
+	inline bool WorkerPool::CheckGrowth() noexcept
+	{
+		auto pending = pull_task_signal->Pending();
+		auto started = StartedTasks();
+		if (pending > 0 && available_workers.load(std::memory_order_relaxed) <= 0 && started - watched_started < static_cast<uint64_t>(watched_pending))
+			Grow();
+		watched_started = started;
+		watched_pending = std::max<int64_t>(pending, 0);
+		quiet_checks = pending > 0 ? 0 : quiet_checks + 1;
+		if (quiet_checks < growth_watch_quiet_checks)
+			return true;
+
+		quiet_checks = 0;
+		growth_watch.store(false, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (pull_task_signal->Pending() > 0)
+		{
+			growth_watch.store(true, std::memory_order_relaxed);
+			return true;
+		}
+		return false;
+	}
+
+	inline void WorkerPool::StopTimers() noexcept
+	{
+		{
+			std::unique_lock lk(timer_mx);
+			timers_stopped = true;
+		}
+		timer_cv.notify_one();
+		if (timer_thread.joinable())
+			timer_thread.join();
+
+		std::unique_lock lk(timer_mx);
+		timer_wheel.Clear([this](TimerEntry* entry) { ReleaseTimer(entry); });
+	}
+
+	inline bool WorkerPool::RunPendingTask() noexcept
+	{
+		if (current_worker.pool != this || !pull_task_signal->TryAcquire())
+			return false;
+
+		auto index = current_worker.index;
+		TaskRecord* record = nullptr;
+		while (!(record = TryTakeTask(index)))
+		{
+			/*
+			* The signal was a retirement request (or the stop) rather than a task. A worker inside a task can't retire,
+			* hand it back to the others.
+			* */
+			if (TryConsumeRetireRequest())
+			{
+				retire_requests.fetch_add(1);
+				pull_task_signal->Release();
+				return false;
+			}
+			if (cancel_flag && AllQueuesEmpty())
+			{
+				pull_task_signal->Release();
+				return false;
+			}
+			std::this_thread::yield();
+		}
+		WORKERPOOL_TRACE(TracePoint::Dequeue, record, index);
+
+		Execute(record);
+		return true;
+	}
+
+	inline void WorkerPool::routine(unsigned int index, unsigned int spawn_end) noexcept
+	{
+		StartSlots(index, spawn_end);
+		current_worker = { this, index };
+		workers[index]->counters.idle_since_ns.store(SinceEpochNs(std::chrono::steady_clock::now()), std::memory_order_relaxed);
+		if (!workers[index]->cpus.empty())
+			CpuTopology::PinCurrentThread(workers[index]->cpus);
+
+		for (bool ready = false; true;)
+		{
+			available_workers++;
+			if (!std::exchange(ready, true))
+				CountDown(starting_threads, 1);
+			if (!cancel_flag && !WaitForTask(index))
+			{
+				available_workers--;
+				return;
+			}
+			available_workers--;
+
+			/*
+			* Before the pool is stopped every acquired signal stands for one queued task, but a steal can lose a race
+			* so keep looking until it is found. After the stop, drain whatever is left and leave.
+			* */
+			TaskRecord* record = nullptr;
+			while (!(record = TryTakeTask(index)))
+			{
+				if (cancel_flag && AllQueuesEmpty())
+					return;
+				std::this_thread::yield();
+			}
+			WORKERPOOL_TRACE(TracePoint::Dequeue, record, index);
+
+			Execute(record);
 		}
 	}
-}
\ No newline at end of file
+}
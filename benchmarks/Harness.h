@@ -0,0 +1,222 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+* Minimal benchmark runner, no dependency besides the standard library so it builds wherever the pool does.
+* Every case runs warmup untimed repetitions, then the measured ones. The samples of a case are summarized
+* (mean, standard deviation, coefficient of variation, min, median, max), printed as a table and optionally written as JSON,
+* so two runs (two versions of the pool) can be compared by a script.
+* */
+namespace bench
+{
+	struct Options
+	{
+		int repetitions = 10;
+		int warmup = 2;
+		bool quick = false; //smaller workloads, for smoke runs
+		std::string filter; //only the cases whose name contains it
+		std::string json_path;
+	};
+
+	inline Options ParseOptions(int argc, char** argv)
+	{
+		Options options;
+		for (int i = 1; i < argc; i++)
+		{
+			std::string arg = argv[i];
+			auto value = [&arg](const char* key) -> const char* {
+				auto length = std::strlen(key);
+				return arg.compare(0, length, key) == 0 ? arg.c_str() + length : nullptr;
+			};
+			if (auto v = value("--repetitions="))
+				options.repetitions = std::max(std::atoi(v), 1);
+			else if (auto v = value("--warmup="))
+				options.warmup = std::max(std::atoi(v), 0);
+			else if (auto v = value("--filter="))
+				options.filter = v;
+			else if (auto v = value("--json="))
+				options.json_path = v;
+			else if (arg == "--quick")
+				options.quick = true;
+			else
+			{
+				std::cerr << "usage: " << argv[0] << " [--repetitions=N] [--warmup=N] [--filter=substring] [--json=path] [--quick]" << std::endl;
+				std::exit(arg == "--help" ? 0 : 1);
+			}
+		}
+		return options;
+	}
+
+	struct Result
+	{
+		std::string name;
+		std::string unit;
+		std::vector<double> samples;
+		double mean = 0;
+		double stddev = 0;
+		double min = 0;
+		double median = 0;
+		double max = 0;
+
+		double CoefficientOfVariation() const { return mean != 0 ? stddev / mean * 100.0 : 0; }
+
+		void Summarize()
+		{
+			auto sorted = samples;
+			std::sort(sorted.begin(), sorted.end());
+			auto n = sorted.size();
+			mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / static_cast<double>(n);
+			double squares = 0;
+			for (auto s : sorted) squares += (s - mean) * (s - mean);
+			stddev = n > 1 ? std::sqrt(squares / static_cast<double>(n - 1)) : 0;
+			min = sorted.front();
+			max = sorted.back();
+			median = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+		}
+	};
+
+	//p in [0, 100] of an unsorted set of values, nearest rank
+	inline double Percentile(std::vector<double> values, double p)
+	{
+		if (values.empty())
+			return 0;
+		auto rank = static_cast<size_t>(std::ceil(p / 100.0 * static_cast<double>(values.size())));
+		auto index = std::min(rank > 0 ? rank - 1 : 0, values.size() - 1);
+		std::nth_element(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(index), values.end());
+		return values[index];
+	}
+
+	class Suite
+	{
+	public:
+		explicit Suite(Options options) : options(std::move(options)) {}
+
+		[[nodiscard]] const Options& Settings() const noexcept { return options; }
+
+		[[nodiscard]] bool Selected(const std::string& name) const
+		{
+			return options.filter.empty() || name.find(options.filter) != std::string::npos;
+		}
+
+		/*
+		* Runs a case producing several metrics per repetition (for instance latency percentiles), reported as name/metric.
+		* sample() runs one repetition and returns one value per metric.
+		* */
+		template <typename Sample>
+		void Run(const std::string& name, const std::string& unit, const std::vector<std::string>& metrics, Sample&& sample)
+		{
+			if (!Selected(name))
+				return;
+
+			for (int i = 0; i < options.warmup; i++)
+				sample();
+
+			std::vector<Result> case_results(metrics.size());
+			for (size_t m = 0; m < metrics.size(); m++)
+			{
+				case_results[m].name = metrics[m].empty() ? name : name + "/" + metrics[m];
+				case_results[m].unit = unit;
+			}
+			for (int i = 0; i < options.repetitions; i++)
+			{
+				std::vector<double> values = sample();
+				for (size_t m = 0; m < metrics.size() && m < values.size(); m++)
+					case_results[m].samples.push_back(values[m]);
+			}
+			for (auto& result : case_results)
+			{
+				result.Summarize();
+				Print(result);
+				results.push_back(std::move(result));
+			}
+		}
+
+		//single metric case, sample() returns the measurement of one repetition
+		template <typename Sample>
+		void Run(const std::string& name, const std::string& unit, Sample&& sample)
+		{
+			Run(name, unit, { "" }, [&sample] { return std::vector<double>{ static_cast<double>(sample()) }; });
+		}
+
+		void PrintHeader() const
+		{
+			std::cout << std::left << std::setw(48) << "benchmark" << std::right << std::setw(14) << "mean" << std::setw(12) << "cv %"
+				<< std::setw(14) << "min" << std::setw(14) << "median" << std::setw(14) << "max" << "  unit" << std::endl;
+		}
+
+		//writes the JSON file if one was asked for, returns the process exit code
+		int Finish() const
+		{
+			if (options.json_path.empty())
+				return 0;
+
+			std::ofstream out(options.json_path);
+			if (!out)
+			{
+				std::cerr << "can't write " << options.json_path << std::endl;
+				return 1;
+			}
+			out << std::setprecision(10);
+			out << "{\"context\":{\"hardware_concurrency\":" << std::thread::hardware_concurrency()
+				<< ",\"compiler\":\"" << Compiler() << "\",\"optimized\":" << (IsOptimizedBuild() ? "true" : "false")
+				<< ",\"repetitions\":" << options.repetitions << ",\"warmup\":" << options.warmup << ",\"quick\":" << (options.quick ? "true" : "false") << "},";
+			out << "\"benchmarks\":[";
+			for (size_t i = 0; i < results.size(); i++)
+			{
+				const auto& r = results[i];
+				out << (i ? "," : "") << "\n{\"name\":\"" << r.name << "\",\"unit\":\"" << r.unit << "\",\"mean\":" << r.mean << ",\"stddev\":" << r.stddev
+					<< ",\"cv_percent\":" << r.CoefficientOfVariation() << ",\"min\":" << r.min << ",\"median\":" << r.median << ",\"max\":" << r.max << ",\"samples\":[";
+				for (size_t s = 0; s < r.samples.size(); s++)
+					out << (s ? "," : "") << r.samples[s];
+				out << "]}";
+			}
+			out << "\n]}" << std::endl;
+			return out ? 0 : 1;
+		}
+
+	private:
+		static void Print(const Result& r)
+		{
+			std::cout << std::left << std::setw(48) << r.name << std::right << std::fixed << std::setprecision(2)
+				<< std::setw(14) << r.mean << std::setw(12) << r.CoefficientOfVariation() << std::setw(14) << r.min
+				<< std::setw(14) << r.median << std::setw(14) << r.max << "  " << r.unit << std::endl;
+			std::cout.unsetf(std::ios::floatfield);
+		}
+
+		static std::string Compiler()
+		{
+#if defined(__clang__)
+			return "clang " __clang_version__;
+#elif defined(__GNUC__)
+			return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+			return "msvc " + std::to_string(_MSC_VER);
+#else
+			return "unknown";
+#endif
+		}
+
+		static bool IsOptimizedBuild()
+		{
+#if defined(NDEBUG)
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		Options options;
+		std::vector<Result> results;
+	};
+}
@@ -0,0 +1,280 @@
+#include "Harness.h"
+#include <atomic>
+#include <future>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../WorkerPool/WorkerPool.hpp"
+#include "../WorkerPool/ParallelAlgorithms.hpp"
+
+/*
+* Microbenchmarks of the pool's hot paths, meant to be run before and after a change:
+*	cmake -S benchmarks -B build && cmake --build build && ./build/benchmarks --json=after.json
+* throughput - empty tasks posted by 1..N producer threads at once, tasks per second
+* latency - submission to start of execution, one task at a time (the worker has to be woken up) and in a burst
+* fanout - SubmitBatch of width tasks and waiting for the handle, per round
+* lifecycle - constructing a pool until all its workers are up, and destroying it
+* startup - the same for 1..1000 threads and every ThreadStart, and with threads reused from the ThreadCache: the constructor,
+*	the wait for the workers (WaitUntilReady) and the destructor
+* reduce - sum of an int array with ParallelReduce, next to std::accumulate on the calling thread
+* allocation - Submit from every hardware thread at once, with task records and completion slots allocated and freed per task
+*	(unpooled, PoolOptions::recycle_records = false), recycled from slabs of malloc (malloc) or recycled from slabs of a
+*	std::pmr::synchronized_pool_resource (pmr_pool), on a warmed up pool and on a pool constructed just before (cold)
+* */
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double MicrosecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+	}
+
+	void WaitFor(const std::atomic<size_t>& counter, size_t expected)
+	{
+		while (counter.load(std::memory_order_acquire) < expected) std::this_thread::yield();
+	}
+
+	void WaitForWorkers(ms::WorkerPool& pool)
+	{
+		pool.WaitUntilReady();
+	}
+
+	std::vector<unsigned int> ProducerCounts()
+	{
+		auto hardware = std::max(std::thread::hardware_concurrency(), 1u);
+		std::vector<unsigned int> counts;
+		for (unsigned int p = 1; p < hardware; p *= 2) counts.push_back(p);
+		counts.push_back(hardware);
+		return counts;
+	}
+
+	void Throughput(bench::Suite& suite)
+	{
+		const size_t tasks = suite.Settings().quick ? 20'000 : 500'000;
+		ms::WorkerPool pool;
+		WaitForWorkers(pool);
+		for (auto producers : ProducerCounts())
+		{
+			suite.Run("throughput/producers:" + std::to_string(producers), "tasks/s", [&] {
+				std::atomic<size_t> done(0);
+				std::atomic<bool> go(false);
+				auto per_producer = tasks / producers;
+				std::vector<std::thread> threads;
+				for (unsigned int p = 0; p < producers; p++)
+				{
+					threads.emplace_back([&] {
+						while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+						for (size_t i = 0; i < per_producer; i++)
+							pool.Post([&done] { done.fetch_add(1, std::memory_order_release); });
+					});
+				}
+				auto start = Clock::now();
+				go.store(true, std::memory_order_release);
+				for (auto& t : threads) t.join();
+				WaitFor(done, per_producer * producers);
+				return static_cast<double>(per_producer * producers) / (MicrosecondsSince(start) / 1e6);
+			});
+		}
+	}
+
+	/*
+	* burst = false: every task is submitted once the previous one ran, so the worker is idle (parked or spinning, depending
+	* on the wait strategy) each time. burst = true: all of them are submitted back to back, the queueing delay adds up.
+	* */
+	void Latency(bench::Suite& suite, bool burst)
+	{
+		const size_t tasks = suite.Settings().quick ? 2'000 : (burst ? 100'000 : 20'000);
+		ms::WorkerPool pool;
+		WaitForWorkers(pool);
+		std::vector<double> latencies(tasks);
+		suite.Run(burst ? "latency/burst" : "latency/idle", "us", { "p50", "p90", "p99", "p99.9" }, [&] {
+			std::atomic<size_t> done(0);
+			for (size_t i = 0; i < tasks; i++)
+			{
+				auto submitted = Clock::now();
+				pool.Post([&latencies, &done, i, submitted] {
+					latencies[i] = MicrosecondsSince(submitted);
+					done.fetch_add(1, std::memory_order_release);
+				});
+				if (!burst)
+					WaitFor(done, i + 1);
+			}
+			WaitFor(done, tasks);
+			return std::vector<double>{ bench::Percentile(latencies, 50), bench::Percentile(latencies, 90), bench::Percentile(latencies, 99), bench::Percentile(latencies, 99.9) };
+		});
+	}
+
+	void FanOut(bench::Suite& suite)
+	{
+		const int rounds = suite.Settings().quick ? 20 : 200;
+		ms::WorkerPool pool;
+		WaitForWorkers(pool);
+		for (size_t width : { 1, 16, 256, 4096 })
+		{
+			suite.Run("fanout/width:" + std::to_string(width), "us/round", [&] {
+				auto start = Clock::now();
+				for (int r = 0; r < rounds; r++)
+				{
+					pool.SubmitBatch(width, [](size_t) { return [] {}; }).Wait();
+				}
+				return MicrosecondsSince(start) / rounds;
+			});
+		}
+	}
+
+	void Lifecycle(bench::Suite& suite)
+	{
+		suite.Run("lifecycle/threads:" + std::to_string(std::thread::hardware_concurrency()), "us", { "construct", "destroy" }, [] {
+			std::optional<ms::WorkerPool> pool;
+			auto start = Clock::now();
+			pool.emplace();
+			WaitForWorkers(*pool);
+			auto constructed = MicrosecondsSince(start);
+			start = Clock::now();
+			pool.reset();
+			return std::vector<double>{ constructed, MicrosecondsSince(start) };
+		});
+	}
+
+	void Startup(bench::Suite& suite)
+	{
+		struct Variant
+		{
+			const char* name;
+			ms::ThreadStart start;
+			bool reuse;
+		};
+		const Variant variants[] = {
+			{ "eager", ms::ThreadStart::Eager, false },
+			{ "parallel", ms::ThreadStart::Parallel, false },
+			{ "lazy", ms::ThreadStart::Lazy, false },
+			{ "reused", ms::ThreadStart::Parallel, true },
+		};
+		for (unsigned int threads : { 1u, 10u, 100u, 1'000u })
+		{
+			for (const auto& variant : variants)
+			{
+				ms::PoolOptions options;
+				options.capacity = threads;
+				options.thread_start = variant.start;
+				options.reuse_threads = variant.reuse;
+				suite.Run("startup/threads:" + std::to_string(threads) + "/" + variant.name, "us", { "construct", "ready", "destroy" }, [&options] {
+					std::optional<ms::WorkerPool> pool;
+					auto start = Clock::now();
+					pool.emplace(options);
+					auto constructed = MicrosecondsSince(start);
+					pool->WaitUntilReady();
+					auto ready = MicrosecondsSince(start);
+					start = Clock::now();
+					pool.reset();
+					return std::vector<double>{ constructed, ready, MicrosecondsSince(start) };
+				});
+			}
+		}
+		ms::ThreadCache::Instance().Trim();
+	}
+
+	void Reduce(bench::Suite& suite)
+	{
+		std::vector<size_t> sizes{ 10'000, 1'000'000, 10'000'000 };
+		if (!suite.Settings().quick)
+			sizes.push_back(100'000'000);
+		ms::WorkerPool pool;
+		WaitForWorkers(pool);
+		for (auto size : sizes)
+		{
+			auto name = "reduce/size:" + std::to_string(size);
+			//skips allocating the array when both cases are filtered out
+			if (!suite.Selected(name + "/parallel") && !suite.Selected(name + "/sequential"))
+				continue;
+
+			std::vector<int> values(size, 1);
+			volatile long long sink = 0;
+			suite.Run(name + "/parallel", "us", [&] {
+				auto start = Clock::now();
+				sink = ms::ParallelReduce(pool, values, 0ll, [](long long a, long long b) { return a + b; });
+				return MicrosecondsSince(start);
+			});
+			suite.Run(name + "/sequential", "us", [&] {
+				auto start = Clock::now();
+				sink = std::accumulate(values.begin(), values.end(), 0ll);
+				return MicrosecondsSince(start);
+			});
+			if (sink != static_cast<long long>(size))
+			{
+				std::cerr << name << ": wrong sum " << sink << std::endl;
+				std::exit(1);
+			}
+		}
+	}
+
+	//Submit calls per second, producers submitting at once. A handle's slot and its task's record are all a task allocates
+	double SubmitThroughput(ms::WorkerPool& pool, size_t tasks)
+	{
+		auto producers = std::max(std::thread::hardware_concurrency(), 1u);
+		auto per_producer = tasks / producers;
+		std::atomic<bool> go(false);
+		std::vector<std::thread> threads;
+		for (unsigned int p = 0; p < producers; p++)
+		{
+			threads.emplace_back([&] {
+				std::vector<ms::ResultHandle<void>> handles;
+				handles.reserve(per_producer);
+				while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+				for (size_t i = 0; i < per_producer; i++)
+					handles.push_back(pool.Submit([] {}));
+				for (auto& h : handles) h.Wait();
+			});
+		}
+		auto start = Clock::now();
+		go.store(true, std::memory_order_release);
+		for (auto& t : threads) t.join();
+		return static_cast<double>(per_producer * producers) / (MicrosecondsSince(start) / 1e6);
+	}
+
+	/*
+	* unpooled - every record and completion slot from malloc and back, the baseline
+	* malloc - recycled records, slabs from the heap
+	* pmr_pool - recycled records, slabs from a synchronized_pool_resource
+	* */
+	void Allocation(bench::Suite& suite)
+	{
+		const size_t tasks = suite.Settings().quick ? 20'000 : 200'000;
+		for (std::string mode : { "unpooled", "malloc", "pmr_pool" })
+		{
+			auto name = "allocation/" + mode;
+			std::pmr::synchronized_pool_resource resource;
+			ms::PoolOptions options;
+			options.memory_resource = mode == "pmr_pool" ? &resource : nullptr;
+			options.recycle_records = mode != "unpooled";
+
+			suite.Run(name + "/cold", "tasks/s", [&] {
+				ms::WorkerPool pool(options);
+				WaitForWorkers(pool);
+				return SubmitThroughput(pool, tasks);
+			});
+
+			ms::WorkerPool pool(options);
+			WaitForWorkers(pool);
+			suite.Run(name + "/warm", "tasks/s", [&] { return SubmitThroughput(pool, tasks); });
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bench::Suite suite(bench::ParseOptions(argc, argv));
+	suite.PrintHeader();
+	Throughput(suite);
+	Latency(suite, false);
+	Latency(suite, true);
+	FanOut(suite);
+	Lifecycle(suite);
+	Startup(suite);
+	Reduce(suite);
+	Allocation(suite);
+	return suite.Finish();
+}
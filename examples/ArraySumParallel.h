@@ -3,6 +3,8 @@
 #include <iostream>
 #include <vector>
 #include "..\WorkerPool\WorkerPool.hpp"
+#include "..\WorkerPool\Executor.hpp"
+#include "..\WorkerPool\WorkerLocal.hpp"
 #include <numeric>
 #include <functional>
 
@@ -17,59 +19,38 @@ long long ArraySumParallelThreadPool(const std::vector<int>& nums, unsigned int
 {
 	PROFILE_FUNCTION();
 
-	//Create the workerpool with default number of worker threads (hardware concurrency) 12 in my device
-	auto threadpool = ms::WorkerPool();
-
-	while (!threadpool.AreAllWorkersAvailable()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	//the process wide pool (hardware concurrency threads, 12 in my device), started once instead of on every call
+	auto& threadpool = ms::DefaultPool();
 
 	auto available_hw_concurrency = std::thread::hardware_concurrency();
 
-	unsigned int chunk_size_calculated = N / (available_hw_concurrency - 1);
-	unsigned int total_processed_size = 0;
-
-	auto process_chunk = [](std::vector<int>::const_iterator start, std::vector<int>::const_iterator end, std::shared_ptr<long long> chunk_sum_res_ptr) noexcept
-	{
-		//auto &[start, end, chunk_sum_res_ptr, _sem] = args;
-		try {
-			*chunk_sum_res_ptr = std::accumulate(start, end, 0ll);
-		}
-		catch (const std::exception& ex)
-		{
+	//at least one element per chunk, arrays smaller than the pool would get empty chunks otherwise
+	unsigned int chunk_size_calculated = std::max(N / std::max(available_hw_concurrency - 1, 1u), 1u);
 
-		}
-	};
+	//every worker adds its chunks into its own cache line padded partial sum, no allocation per chunk and no shared atomic
+	ms::Combinable<long long> partial_sums(threadpool);
 
-	//auto sum = std::make_shared<long long>(0ll);
 	auto sum = 0ll;
-	std::vector<std::shared_ptr<long long>> results;
-	std::vector<std::future<void>> futures;
-	results.reserve(20); //just for performance benefits, since shared_ptrs are used we need not worry about vector reallocation and reference invalidations
+	auto chunk_count = (N + chunk_size_calculated - 1) / chunk_size_calculated;
 	
 	{
 		PROFILE_SCOPE("ArraySumParallelThreadPool only calculation");
-		int i = 0;
-		while (total_processed_size < N)
-		{
-			auto original_chunk_size = std::min(chunk_size_calculated, N - total_processed_size);
-			auto start = nums.begin() + total_processed_size;
+
+		//all the chunks are published to the pool at once, with a single handle to wait on instead of a future per chunk
+		auto all_chunks = threadpool.SubmitBatch(chunk_count, [&](size_t i) {
+			auto chunk_begin = static_cast<unsigned int>(i) * chunk_size_calculated;
+			auto original_chunk_size = std::min(chunk_size_calculated, N - chunk_begin);
+			auto start = nums.begin() + chunk_begin;
 			auto end = start + original_chunk_size;
-			total_processed_size += original_chunk_size;
-
-			results.emplace_back(std::make_shared<long long>(0ll));
-			
-			futures.emplace_back(threadpool.AddTaskForExecution(std::bind(process_chunk, start, end, results[i++])));
-			/*
-			* Bind can be used as above or a lambda capturing all the required objects can be used as well, for example 
-			* [&process_chunk, start, end, &results, i]() { process_chunk(start, end, results[i]); }
-			* or any callable which adheres to the std::function<void()>
-			* */
-		}
+
+			return [&partial_sums, start, end]() { partial_sums.Local() += std::accumulate(start, end, 0ll); };
+		});
 
 		//wait for all the tasks to complete
-		std::for_each(futures.begin(), futures.end(), [](auto& f) { f.wait(); });
+		all_chunks.Wait();
 
-		//add the individual chunk results
-		std::for_each(results.begin(), results.end(), [&sum](auto& val) { sum += *val; });
+		//add the per worker results
+		sum = partial_sums.Combine(std::plus<long long>());
 	}
 	return sum;
 }
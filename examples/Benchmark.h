@@ -17,6 +17,30 @@
 #include <string>
 #include <chrono>
 #include <fstream>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <iomanip>
+#include <utility>
+#include <algorithm>
+#include <thread>
+#include <functional>
+#include <cstdint>
+#include "..\WorkerPool\Tracing.hpp"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
 
 struct ProfileResult {
     std::string Name;
@@ -29,6 +53,17 @@ struct InstrumentationSession {
     std::string Name;
 };
 
+/*
+* File - one "X" event per profiled scope, written to results.json as it ends
+* Console - one line per profiled scope
+* Trace - per thread buffers written to results.json only at EndSession, see TracingInstrumentor
+* */
+enum class InstrumentorKind {
+    File,
+    Console,
+    Trace
+};
+
 class IInstrumentor
 {
     static std::once_flag _creation_once_flag;
@@ -41,7 +76,13 @@ public:
     virtual void BeginSession(const std::string& name) = 0;
     virtual void WriteProfile(const ProfileResult& result) = 0;
 
-    static IInstrumentor& Get(bool output_to_console = false);
+    //name has to outlive the session, timestamps are steady_clock nanoseconds
+    virtual void WriteEvent(const char* name, long long start_ns, long long end_ns) {
+        WriteProfile(ProfileResult(name, start_ns / 1000, end_ns / 1000));
+    }
+
+    //the kind is only looked at by the first call, the instrumentor is created once for the whole program
+    static IInstrumentor& Get(InstrumentorKind kind = InstrumentorKind::File);
 
     void SetCurrentSessionName(const std::string& name)
     {
@@ -129,14 +170,234 @@ public:
     }
 };
 
+/*
+* Low overhead tracing. Every thread appends its events to its own chain of fixed size chunks, without any lock
+* (the lock is only taken once per thread and session, to register the thread's buffer). Nothing is formatted
+* before EndSession, which writes Chrome trace JSON (chrome://tracing, ui.perfetto.dev) to results.json.
+* Timestamps are steady_clock nanoseconds, tids are the OS thread ids (so the trace lines up with other profilers)
+* and the pool's workers are named after their index.
+*
+* With WORKERPOOL_TRACING defined the pool's own trace points are recorded as well: enqueue and dequeue instants
+* and a "task" slice around every execution, so the scheduling gaps of each worker show up on its row.
+* The buffers of a session are freed when the next one begins, threads must be done tracing into the old one by then.
+* */
+class TracingInstrumentor : public IInstrumentor {
+    struct Event {
+        const char* name;
+        long long start_ns;
+        long long end_ns;
+        const void* task;
+        char phase;
+    };
+
+    //never moved once published, so EndSession can read them while the owner keeps appending
+    struct Chunk {
+        static constexpr size_t capacity = 4096;
+        Event events[capacity];
+        std::atomic<size_t> used{ 0 };
+        std::atomic<Chunk*> next{ nullptr };
+    };
+
+    struct ThreadBuffer {
+        ThreadBuffer() : tid(CurrentThreadId()), head(new Chunk), tail(head) {}
+        ~ThreadBuffer() {
+            for (auto chunk = head; chunk;)
+                delete std::exchange(chunk, chunk->next.load());
+        }
+
+        uint64_t tid;
+        std::atomic<unsigned int> worker{ ~0u };
+        Chunk* head;
+        Chunk* tail; //owner only
+    };
+
+    struct LocalBuffer {
+        unsigned long long session;
+        ThreadBuffer* buffer;
+    };
+
+    static inline thread_local LocalBuffer local{ 0, nullptr };
+    static inline std::atomic<TracingInstrumentor*> active{ nullptr };
+
+    std::atomic<unsigned long long> session{ 0 }; //odd while a session records
+    long long session_start_ns = 0;
+    std::mutex buffers_mx;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    std::vector<ProfileResult> profiles; //WriteProfile callers, under buffers_mx
+    const std::string filepath = "results.json";
+
+    //the id the OS and its profilers know the calling thread by, std::thread::id only where there is no such id
+    static uint64_t CurrentThreadId() {
+#if defined(_WIN32)
+        return GetCurrentThreadId();
+#elif defined(__linux__)
+        return static_cast<uint64_t>(syscall(SYS_gettid));
+#else
+        return std::hash<std::thread::id>{}(std::this_thread::get_id());
+#endif
+    }
+
+    static long long NowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    ThreadBuffer* Buffer() {
+        auto current = session.load(std::memory_order_acquire);
+        if (!(current & 1))
+            return nullptr;
+        if (local.session == current)
+            return local.buffer;
+
+        std::unique_lock lk(buffers_mx);
+        if (session.load(std::memory_order_relaxed) != current)
+            return nullptr;
+        buffers.push_back(std::make_unique<ThreadBuffer>());
+        local = { current, buffers.back().get() };
+        return local.buffer;
+    }
+
+    void Record(ThreadBuffer& buffer, const Event& event) {
+        auto chunk = buffer.tail;
+        auto used = chunk->used.load(std::memory_order_relaxed);
+        if (used == Chunk::capacity) {
+            auto fresh = new Chunk;
+            chunk->next.store(fresh, std::memory_order_release);
+            buffer.tail = chunk = fresh;
+            used = 0;
+        }
+        chunk->events[used] = event;
+        chunk->used.store(used + 1, std::memory_order_release);
+    }
+
+    static void OnPoolEvent(ms::TracePoint point, const void* task, unsigned int worker, int64_t time_ns) noexcept {
+        auto instance = active.load(std::memory_order_acquire);
+        if (!instance)
+            return;
+        try {
+            auto buffer = instance->Buffer();
+            if (!buffer)
+                return;
+            if (worker != ~0u && buffer->worker.load(std::memory_order_relaxed) != worker)
+                buffer->worker.store(worker, std::memory_order_relaxed);
+
+            switch (point) {
+            case ms::TracePoint::Enqueue: instance->Record(*buffer, { "enqueue", time_ns, time_ns, task, 'i' }); break;
+            case ms::TracePoint::Dequeue: instance->Record(*buffer, { "dequeue", time_ns, time_ns, task, 'i' }); break;
+            case ms::TracePoint::Start: instance->Record(*buffer, { "task", time_ns, time_ns, task, 'B' }); break;
+            case ms::TracePoint::Finish: instance->Record(*buffer, { "task", time_ns, time_ns, task, 'E' }); break;
+            }
+        }
+        catch (...) {
+            //out of memory for a new chunk, the event is dropped
+        }
+    }
+
+    void WriteTimestamp(const char* key, long long ns) {
+        m_OutputStream << ",\"" << key << "\":" << static_cast<double>(ns) / 1000.0;
+    }
+
+    void WriteName(const char* name) {
+        std::string escaped = name;
+        std::replace(escaped.begin(), escaped.end(), '"', '\'');
+        std::replace(escaped.begin(), escaped.end(), '\\', '/');
+        m_OutputStream << "\"name\":\"" << escaped << "\"";
+    }
+
+    std::ofstream m_OutputStream;
+
+public:
+    virtual void BeginSession(const std::string& name) {
+        {
+            std::unique_lock lk(buffers_mx);
+            buffers.clear();
+            profiles.clear();
+            session_start_ns = NowNs();
+            session.fetch_add(1, std::memory_order_release);
+        }
+        SetCurrentSessionName(name);
+        active.store(this, std::memory_order_release);
+        ms::SetTraceHook(&TracingInstrumentor::OnPoolEvent);
+    }
+
+    virtual void EndSession() {
+        ms::SetTraceHook(nullptr);
+        session.fetch_add(1, std::memory_order_acq_rel);
+        std::unique_lock lk(buffers_mx);
+
+        m_OutputStream.open(filepath);
+        m_OutputStream << std::fixed << std::setprecision(3);
+        m_OutputStream << "{\"otherData\": {},\"traceEvents\":[";
+        bool first = true;
+        auto begin_event = [&](const char* category, char phase, uint64_t tid) {
+            m_OutputStream << (first ? "" : ",") << "{\"cat\":\"" << category << "\",\"ph\":\"" << phase << "\",\"pid\":0,\"tid\":" << tid << ",";
+            first = false;
+        };
+
+        for (auto& buffer : buffers) {
+            auto worker = buffer->worker.load(std::memory_order_relaxed);
+            begin_event("__metadata", 'M', buffer->tid);
+            auto thread_name = worker != ~0u ? "worker " + std::to_string(worker) : "thread " + std::to_string(buffer->tid);
+            WriteName("thread_name");
+            m_OutputStream << ",\"args\":{";
+            WriteName(thread_name.c_str());
+            m_OutputStream << "}}";
+
+            for (auto chunk = buffer->head; chunk; chunk = chunk->next.load(std::memory_order_acquire)) {
+                auto used = chunk->used.load(std::memory_order_acquire);
+                for (size_t i = 0; i < used; i++) {
+                    const auto& event = chunk->events[i];
+                    begin_event(event.task ? "pool" : "function", event.phase, buffer->tid);
+                    WriteName(event.name);
+                    WriteTimestamp("ts", event.start_ns - session_start_ns);
+                    if (event.phase == 'X')
+                        WriteTimestamp("dur", event.end_ns - event.start_ns);
+                    if (event.phase == 'i')
+                        m_OutputStream << ",\"s\":\"t\"";
+                    if (event.task)
+                        m_OutputStream << ",\"args\":{\"task\":\"" << event.task << "\"}";
+                    m_OutputStream << "}";
+                }
+            }
+        }
+        for (const auto& profile : profiles) {
+            begin_event("function", 'X', 0);
+            WriteName(profile.Name.c_str());
+            WriteTimestamp("ts", profile.Start * 1000 - session_start_ns);
+            WriteTimestamp("dur", (profile.End - profile.Start) * 1000);
+            m_OutputStream << "}";
+        }
+        m_OutputStream << "]}";
+        m_OutputStream.close();
+
+        active.store(nullptr, std::memory_order_release);
+        delete m_CurrentSession;
+        m_CurrentSession = nullptr;
+    }
+
+    virtual void WriteEvent(const char* name, long long start_ns, long long end_ns) {
+        if (auto buffer = Buffer())
+            Record(*buffer, { name, start_ns, end_ns, nullptr, 'X' });
+    }
+
+    //slow path for results handed over directly, they are kept under a lock
+    virtual void WriteProfile(const ProfileResult& result) {
+        if (!(session.load(std::memory_order_acquire) & 1))
+            return;
+        std::unique_lock lk(buffers_mx);
+        profiles.push_back(result);
+    }
+};
+
 std::once_flag IInstrumentor::_creation_once_flag = std::once_flag();
 
-IInstrumentor& IInstrumentor::Get(bool output_to_console) {
+IInstrumentor& IInstrumentor::Get(InstrumentorKind kind) {
     static IInstrumentor* instance = nullptr;
     std::call_once(_creation_once_flag,
-        [output_to_console]() {
-            if (output_to_console)
+        [kind]() {
+            if (kind == InstrumentorKind::Console)
                 instance = new ConsoleInstrumentator();
+            else if (kind == InstrumentorKind::Trace)
+                instance = new TracingInstrumentor();
             else
                 instance = new FilestreamInstrumentor();
         }
@@ -152,7 +413,7 @@ public:
     InstrumentationTimer(const char* name)
         : m_Name(name), m_Stopped(false) {
 
-        m_StartTimepoint = std::chrono::high_resolution_clock::now();
+        m_StartTimepoint = std::chrono::steady_clock::now();
     }
 
     ~InstrumentationTimer() {
@@ -161,12 +422,12 @@ public:
     }
 
     void Stop() {
-        auto endTimepoint = std::chrono::high_resolution_clock::now();
+        auto endTimepoint = std::chrono::steady_clock::now();
 
-        long long start = std::chrono::time_point_cast<std::chrono::microseconds>(m_StartTimepoint).time_since_epoch().count();
-        long long end = std::chrono::time_point_cast<std::chrono::microseconds>(endTimepoint).time_since_epoch().count();
+        long long start = std::chrono::time_point_cast<std::chrono::nanoseconds>(m_StartTimepoint).time_since_epoch().count();
+        long long end = std::chrono::time_point_cast<std::chrono::nanoseconds>(endTimepoint).time_since_epoch().count();
 
-        IInstrumentor::Get().WriteProfile(ProfileResult(m_Name, start, end));
+        IInstrumentor::Get().WriteEvent(m_Name, start, end);
 
         m_Stopped = true;
     }
@@ -175,7 +436,8 @@ public:
 #if BENCHMARKING
 #define PROFILE_SCOPE(name) InstrumentationTimer timer(name)
 #define START_SESSION(name) IInstrumentor::Get().BeginSession(name)
-#define START_CONSOLE_SESSION(name) IInstrumentor::Get(true).BeginSession(name)
+#define START_CONSOLE_SESSION(name) IInstrumentor::Get(InstrumentorKind::Console).BeginSession(name)
+#define START_TRACE_SESSION(name) IInstrumentor::Get(InstrumentorKind::Trace).BeginSession(name)
 #define END_SESSION() IInstrumentor::Get().EndSession()
 #define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
 #define PROFILE_FUNCTION_DETAILED() PROFILE_SCOPE(__PRETTY_FUNCTION__)
@@ -185,6 +447,7 @@ public:
 #define PROFILE_FUNCTION() 
 #define PROFILE_FUNCTION_DETAILED()
 #define START_CONSOLE_SESSION(name)
+#define START_TRACE_SESSION(name)
 #define END_SESSION()
 #endif
 
@@ -0,0 +1,118 @@
+#pragma once
+#include "Benchmark.h"
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <string>
+#include <numeric>
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include "..\WorkerPool\WorkerPool.hpp"
+
+/*
+* Large array reduction (the ArraySumParallelMainRoutine workload) on a multi socket machine.
+* The array is split in one part per NUMA node and every part is first touched by its node's pinned workers, so its pages
+* live in that node's memory. The parts are then summed by tasks posted
+* local - to the node holding the part
+* remote - to the next node, every read crosses the interconnect
+* no hint - through the global queue of a pool which is neither NUMA aware nor pinned
+* On a single node machine the three numbers only differ by noise.
+* */
+namespace numa_reduction
+{
+	constexpr int repetitions = 5;
+
+	struct Part
+	{
+		std::unique_ptr<int[]> values;
+		size_t size = 0;
+	};
+
+	//runs chunk(node, begin, end) for every chunk of every part, posted to the node picked by target(node)
+	template <typename Target, typename Chunk>
+	void ForEachChunk(ms::WorkerPool& pool, const std::vector<Part>& parts, Target target, Chunk chunk)
+	{
+		std::vector<ms::CompletionHandle> handles;
+		auto chunks_per_part = std::max(pool.ThreadCount() / static_cast<unsigned int>(parts.size()), 1u) * 4;
+		for (unsigned int node = 0; node < parts.size(); node++)
+		{
+			auto chunk_size = (parts[node].size + chunks_per_part - 1) / chunks_per_part;
+			for (size_t begin = 0; begin < parts[node].size; begin += chunk_size)
+			{
+				auto end = std::min(begin + chunk_size, parts[node].size);
+				auto task = [&chunk, node, begin, end] { chunk(node, begin, end); };
+				auto hint = target(node);
+				handles.push_back(hint ? pool.PostWithHandle(ms::NumaNode{ *hint }, task) : pool.PostWithHandle(task));
+			}
+		}
+		for (auto& handle : handles) handle.Wait();
+	}
+
+	//best of the repetitions, in microseconds
+	template <typename Target>
+	long long TimeSum(ms::WorkerPool& pool, const std::vector<Part>& parts, Target target, long long& sum)
+	{
+		long long best = -1;
+		for (int r = 0; r < repetitions; r++)
+		{
+			//a handful of chunks per worker, one atomic add per chunk is noise
+			std::atomic<long long> total(0);
+			auto start = std::chrono::steady_clock::now();
+			ForEachChunk(pool, parts, target, [&](unsigned int node, size_t begin, size_t end) {
+				total += std::accumulate(parts[node].values.get() + begin, parts[node].values.get() + end, 0ll);
+			});
+			long long elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+			sum = total;
+			best = best < 0 ? elapsed : std::min(best, elapsed);
+		}
+		return best;
+	}
+}
+
+void NumaArraySumMainRoutine(size_t N = 1'000'000'000)
+{
+	using namespace numa_reduction;
+	START_CONSOLE_SESSION("NUMA local vs remote array sum");
+
+	ms::PoolOptions numa_options;
+	numa_options.numa_aware = true;
+	numa_options.pin_workers = true;
+	ms::WorkerPool numa_pool(numa_options);
+	ms::WorkerPool plain_pool;
+	numa_pool.WaitUntilReady();
+	plain_pool.WaitUntilReady();
+
+	auto nodes = numa_pool.NodeCount();
+	std::cout << "N is " << N << ", NUMA nodes: " << nodes << std::endl;
+
+	//first touch from the owning node's workers places the pages on that node
+	std::vector<Part> parts(nodes);
+	for (unsigned int node = 0; node < nodes; node++)
+	{
+		parts[node].size = N / nodes + (node < N % nodes ? 1 : 0);
+		parts[node].values.reset(new int[parts[node].size]);
+	}
+	ForEachChunk(numa_pool, parts, [](unsigned int node) { return std::optional<unsigned int>(node); }, [&](unsigned int node, size_t begin, size_t end) {
+		std::fill(parts[node].values.get() + begin, parts[node].values.get() + end, 1);
+	});
+
+	long long local_sum = 0, remote_sum = 0, plain_sum = 0;
+	auto local_us = TimeSum(numa_pool, parts, [](unsigned int node) { return std::optional<unsigned int>(node); }, local_sum);
+	auto remote_us = TimeSum(numa_pool, parts, [nodes](unsigned int node) { return std::optional<unsigned int>((node + 1) % nodes); }, remote_sum);
+	auto plain_us = TimeSum(plain_pool, parts, [](unsigned int) { return std::optional<unsigned int>(); }, plain_sum);
+
+	if (local_sum != static_cast<long long>(N) || remote_sum != local_sum || plain_sum != local_sum)
+	{
+		std::cout << "Calculation mismatch" << std::endl;
+	}
+
+	std::cout << "| Placement | Best of " << repetitions << " (us) |" << std::endl;
+	std::cout << "|:---------:|:--------------:|" << std::endl;
+	std::cout << "| local node | " << local_us << " |" << std::endl;
+	std::cout << "| remote node | " << remote_us << " |" << std::endl;
+	std::cout << "| no hint, unpinned | " << plain_us << " |" << std::endl;
+
+	END_SESSION();
+}
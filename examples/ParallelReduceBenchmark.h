@@ -0,0 +1,59 @@
+#pragma once
+#include "Benchmark.h"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <string>
+#include "ArraySumParallel.h"
+#include "..\WorkerPool\ParallelAlgorithms.hpp"
+
+/*
+* ms::ParallelReduce against the sequential ArraySum baseline for 1M to 1B elements.
+* Pool creation is kept out of the measurements, the same pool is reused for every size.
+* */
+long long ArraySumParallelReduce(ms::WorkerPool& pool, const std::vector<int>& nums, unsigned int N)
+{
+	PROFILE_FUNCTION();
+	return ms::ParallelReduce(pool, nums.begin(), nums.begin() + N, 0ll, std::plus<long long>{});
+}
+
+void ParallelReduceBenchmarkMainRoutine(unsigned int max_size = 1'000'000'000)
+{
+	START_CONSOLE_SESSION("ParallelReduce vs sequential");
+
+	ms::WorkerPool pool;
+	pool.WaitUntilReady();
+
+	auto time_us = [](auto&& f) {
+		auto start = std::chrono::steady_clock::now();
+		auto result = f();
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		return std::make_pair(result, elapsed);
+	};
+
+	//the profiler prints as it goes, so the table is collected and printed at the end
+	std::vector<std::string> rows;
+	for (unsigned int N = 1'000'000; N <= max_size && N != 0; N = (N <= max_size / 10) ? N * 10 : 0)
+	{
+		std::vector<int> nums(N);
+		std::generate(nums.begin(), nums.end(), [n = 0]() mutable { return ++n; });
+
+		auto [sum_seq, seq_us] = time_us([&] { return ArraySum(nums, N); });
+		auto [sum_pl, pl_us] = time_us([&] { return ArraySumParallelReduce(pool, nums, N); });
+		if (sum_pl != sum_seq)
+		{
+			std::cout << "Calculation mismatch for " << N << std::endl;
+		}
+		rows.push_back("| " + std::to_string(N) + " | " + std::to_string(seq_us) + " | " + std::to_string(pl_us) + " | " +
+			std::to_string(static_cast<double>(seq_us) / std::max<long long>(pl_us, 1)) + " |");
+	}
+
+	std::cout << "| Array Size | Sequential ArraySum (us) | ms::ParallelReduce (us) | Speedup |" << std::endl;
+	std::cout << "|:-----------:|:-------------------------:|:--------------------------:|:------:|" << std::endl;
+	for (auto& row : rows)
+	{
+		std::cout << row << std::endl;
+	}
+
+	END_SESSION();
+}
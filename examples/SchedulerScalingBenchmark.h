@@ -0,0 +1,84 @@
+#pragma once
+#include "Benchmark.h"
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include "..\WorkerPool\WorkerPool.hpp"
+
+/*
+* Compares the throughput of the two scheduler modes while the number of worker threads grows.
+* Two workloads with tiny tasks so that the scheduling cost is what gets measured:
+* external - the main thread submits all the tasks, every one of them goes through the global queue
+* nested - a few root tasks each submit their children from inside the pool, in WorkStealing mode those stay on the local deques
+* */
+namespace scheduler_scaling
+{
+	constexpr int external_tasks = 200'000;
+	constexpr int nested_roots = 200;
+	constexpr int nested_children = 1'000;
+
+	inline void WaitFor(const std::atomic<int>& counter, int expected)
+	{
+		while (counter.load(std::memory_order_relaxed) < expected) std::this_thread::yield();
+	}
+
+	//returns the tasks per second
+	inline double RunExternal(ms::SchedulerMode mode, unsigned int threads)
+	{
+		ms::WorkerPool pool(ms::PoolOptions{ threads, mode });
+		pool.WaitUntilReady();
+
+		std::atomic<int> counter(0);
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < external_tasks; i++)
+		{
+			pool.AddTaskForExecution([&counter] { counter.fetch_add(1, std::memory_order_relaxed); });
+		}
+		WaitFor(counter, external_tasks);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		return external_tasks / elapsed.count();
+	}
+
+	inline double RunNested(ms::SchedulerMode mode, unsigned int threads)
+	{
+		ms::WorkerPool pool(ms::PoolOptions{ threads, mode });
+		pool.WaitUntilReady();
+
+		std::atomic<int> counter(0);
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < nested_roots; i++)
+		{
+			pool.AddTaskForExecution([&counter, &pool] {
+				for (int j = 0; j < nested_children; j++)
+				{
+					pool.AddTaskForExecution([&counter] { counter.fetch_add(1, std::memory_order_relaxed); });
+				}
+			});
+		}
+		WaitFor(counter, nested_roots * nested_children);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		return nested_roots * nested_children / elapsed.count();
+	}
+}
+
+void SchedulerScalingMainRoutine()
+{
+	using namespace scheduler_scaling;
+
+	std::vector<unsigned int> thread_counts;
+	for (unsigned int t = 1; t < std::thread::hardware_concurrency(); t *= 2) thread_counts.push_back(t);
+	thread_counts.push_back(std::thread::hardware_concurrency());
+
+	std::cout << "| Threads | GlobalQueue external (tasks/s) | WorkStealing external (tasks/s) | GlobalQueue nested (tasks/s) | WorkStealing nested (tasks/s) |" << std::endl;
+	std::cout << "|:-------:|:------------------------------:|:-------------------------------:|:----------------------------:|:-----------------------------:|" << std::endl;
+	for (auto threads : thread_counts)
+	{
+		std::cout << "| " << threads
+			<< " | " << static_cast<long long>(RunExternal(ms::SchedulerMode::GlobalQueue, threads))
+			<< " | " << static_cast<long long>(RunExternal(ms::SchedulerMode::WorkStealing, threads))
+			<< " | " << static_cast<long long>(RunNested(ms::SchedulerMode::GlobalQueue, threads))
+			<< " | " << static_cast<long long>(RunNested(ms::SchedulerMode::WorkStealing, threads))
+			<< " |" << std::endl;
+	}
+}
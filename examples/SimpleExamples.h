@@ -1,5 +1,6 @@
 #pragma once
 #include <iostream>
+#include <string>
 #include "..\WorkerPool\WorkerPool.hpp"
 
 void task1()
@@ -57,4 +58,32 @@ void UsageExampleWithCalllback()
     task3_fut.wait();
     addition_fut.wait();
 
-}//implicitly blocks here until all the other tasks are completed
\ No newline at end of file
+}//implicitly blocks here until all the other tasks are completed
+
+int Multiply(int a, int b)
+{
+    return a * b;
+}
+
+void UsageExampleWithResults()
+{
+    ms::WorkerPool pool(2);
+
+    //Submit forwards the arguments and returns a handle to whatever the callable returns
+    auto product_result = pool.Submit(Multiply, 6, 7);
+    auto text_result = pool.Submit([](std::string prefix, int value) { return prefix + std::to_string(value); }, std::string("value: "), 10);
+    auto failing_result = pool.Submit([]() -> int { throw std::runtime_error("failed inside the pool"); });
+
+    std::cout << "6 * 7 = " << product_result.Get() << std::endl;
+    std::cout << text_result.Get() << std::endl;
+
+    try
+    {
+        failing_result.Get();
+    }
+    catch (const std::exception& ex)
+    {
+        //exceptions thrown by the task are propagated to the caller
+        std::cout << "Task threw: " << ex.what() << std::endl;
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "Benchmark.h"
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include "..\WorkerPool\WorkerPool.hpp"
+
+/*
+* Enqueue to start latency for every WaitStrategy.
+* One task is in flight at a time and the submitter pauses between tasks, so the workers are idle every time a task is posted:
+* that is exactly the handoff the wait strategy decides about (kernel wakeup with Park, none while spinning).
+* */
+namespace wait_strategy_benchmark
+{
+	constexpr int samples_count = 20'000;
+
+	inline const char* Name(ms::WaitStrategy strategy)
+	{
+		switch (strategy)
+		{
+		case ms::WaitStrategy::Park: return "Park";
+		case ms::WaitStrategy::SpinThenPark: return "SpinThenPark";
+		default: return "Spin";
+		}
+	}
+
+	//latencies in nanoseconds, sorted
+	inline std::vector<long long> Measure(ms::WaitStrategy strategy, unsigned int threads, std::chrono::microseconds gap)
+	{
+		ms::PoolOptions options{ threads };
+		options.wait_strategy = strategy;
+		ms::WorkerPool pool(options);
+		pool.WaitUntilReady();
+
+		std::vector<long long> latencies(samples_count);
+		std::atomic<bool> started(false);
+		for (int i = 0; i < samples_count; i++)
+		{
+			started = false;
+			auto enqueued = std::chrono::steady_clock::now();
+			pool.Post([&latencies, &started, enqueued, i] {
+				latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - enqueued).count();
+				started.store(true, std::memory_order_release);
+			});
+			while (!started.load(std::memory_order_acquire)) std::this_thread::yield();
+
+			auto idle_until = std::chrono::steady_clock::now() + gap;
+			while (std::chrono::steady_clock::now() < idle_until);
+		}
+		std::sort(latencies.begin(), latencies.end());
+		return latencies;
+	}
+
+	inline long long Percentile(const std::vector<long long>& sorted, double p)
+	{
+		auto index = static_cast<size_t>(p / 100.0 * (sorted.size() - 1));
+		return sorted[index];
+	}
+}
+
+void WaitStrategyLatencyMainRoutine()
+{
+	using namespace wait_strategy_benchmark;
+	auto threads = std::max(std::thread::hardware_concurrency() / 2, 1u);
+
+	for (auto gap : { std::chrono::microseconds(5), std::chrono::microseconds(200) })
+	{
+		std::cout << "Enqueue to start latency (ns), " << threads << " workers, " << gap.count() << "us idle between tasks" << std::endl;
+		std::cout << "| Strategy | p50 | p90 | p99 | p99.9 | max |" << std::endl;
+		std::cout << "|:--------:|:---:|:---:|:---:|:-----:|:---:|" << std::endl;
+		for (auto strategy : { ms::WaitStrategy::Park, ms::WaitStrategy::SpinThenPark, ms::WaitStrategy::Spin })
+		{
+			auto latencies = Measure(strategy, threads, gap);
+			std::cout << "| " << Name(strategy)
+				<< " | " << Percentile(latencies, 50)
+				<< " | " << Percentile(latencies, 90)
+				<< " | " << Percentile(latencies, 99)
+				<< " | " << Percentile(latencies, 99.9)
+				<< " | " << latencies.back()
+				<< " |" << std::endl;
+		}
+		std::cout << std::endl;
+	}
+}
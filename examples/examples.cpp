@@ -2,6 +2,10 @@
 #include <future>
 #include "Benchmark.h"
 #include "ArraySumParallel.h"
+#include "SchedulerScalingBenchmark.h"
+#include "ParallelReduceBenchmark.h"
+#include "WaitStrategyBenchmark.h"
+#include "NumaReductionBenchmark.h"
 
 void UsingFutures()
 {
@@ -26,7 +30,12 @@ int main()
 {
     //UsingFutures();
     UsageExampleWithCalllback();
+    //UsageExampleWithResults();
     //ArraySumParallelMainRoutine();
+    //SchedulerScalingMainRoutine();
+    //ParallelReduceBenchmarkMainRoutine();
+    //WaitStrategyLatencyMainRoutine();
+    //NumaArraySumMainRoutine();
 
     std::cin.get();
     return 0;
@@ -1,11 +1,50 @@
 #include "pch.h"
 #include "..\WorkerPool\WorkerPool.hpp"
+#include "..\WorkerPool\ParallelAlgorithms.hpp"
+#include "..\WorkerPool\TaskGraph.hpp"
+#include "..\WorkerPool\TaskGroup.hpp"
+#include "..\WorkerPool\Strand.hpp"
+#include "..\WorkerPool\Executor.hpp"
+#include "..\WorkerPool\WorkerLocal.hpp"
+#include "..\WorkerPool\AsyncFile.hpp"
+#include "..\WorkerPool\Coroutines.hpp"
 #include <chrono>
 #include <thread>
 #include <atomic>
+#include <new>
+#include <cstdlib>
+#include <numeric>
+#include <array>
+#include <memory>
+#include <memory_resource>
+#include <random>
+#include <filesystem>
 
 using namespace ms;
 
+/*
+* Counts every heap allocation made by the test binary, used to verify the allocation free paths
+* */
+static std::atomic<long long> allocation_count(0);
+
+void* operator new(std::size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
 TEST(WorkerPoolTests, AddTaskTest)
 {
     WorkerPool pool(2);
@@ -196,4 +235,1834 @@ TEST(WorkerPoolTests, AddTaskAfterStoppingAllThreads)
 
     EXPECT_FALSE(counter, 10);
     EXPECT_GT(except_count, 0);
-}
\ No newline at end of file
+}
+
+TEST(WorkStealingDequeTests, OwnerLifoThiefFifoTest)
+{
+    WorkStealingDeque<int*> deque(2);
+    int items[4] = { 0, 1, 2, 3 };
+
+    for (auto& item : items)
+        deque.Push(&item); //grows past the initial capacity
+
+    EXPECT_EQ(deque.Size(), 4u);
+    EXPECT_EQ(*deque.Steal(), &items[0]);
+    EXPECT_EQ(*deque.Pop(), &items[3]);
+    EXPECT_EQ(*deque.Pop(), &items[2]);
+    EXPECT_EQ(*deque.Steal(), &items[1]);
+    EXPECT_FALSE(deque.Pop().has_value());
+    EXPECT_FALSE(deque.Steal().has_value());
+}
+
+TEST(WorkStealingDequeTests, ConcurrentStealTest)
+{
+    constexpr int N = 100'000;
+    WorkStealingDeque<int*> deque;
+    std::vector<int> items(N, 0);
+    std::atomic<int> taken(0);
+    std::atomic<bool> done(false);
+
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < 3; i++)
+    {
+        thieves.emplace_back([&] {
+            while (!done || !deque.Empty())
+            {
+                if (auto item = deque.Steal())
+                {
+                    (**item)++;
+                    taken++;
+                }
+            }
+        });
+    }
+
+    for (int i = 0; i < N; i++)
+    {
+        deque.Push(&items[i]);
+        if (i % 3 == 0)
+        {
+            if (auto item = deque.Pop())
+            {
+                (**item)++;
+                taken++;
+            }
+        }
+    }
+    done = true;
+    for (auto& t : thieves) t.join();
+
+    //every item has to be taken exactly once
+    EXPECT_EQ(taken, N);
+    EXPECT_TRUE(std::all_of(items.begin(), items.end(), [](int v) { return v == 1; }));
+}
+
+TEST(WorkerPoolTests, WorkStealingNestedTasksTest)
+{
+    std::atomic<int> counter(0);
+    constexpr int N = 100;
+
+    {
+        WorkerPool pool(PoolOptions{ 4, SchedulerMode::WorkStealing });
+
+        for (int i = 0; i < N; i++)
+        {
+            pool.AddTaskForExecution([&counter, &pool] {
+                //submitted from a worker, goes to the local deque and is up for stealing
+                for (int j = 0; j < N; j++)
+                {
+                    pool.AddTaskForExecution([&counter] { counter++; });
+                }
+            });
+        }
+
+        while (counter < N * N) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    EXPECT_EQ(counter, N * N);
+}
+
+TEST(WorkerPoolTests, WorkStealingFuturesAndCallbackTest)
+{
+    WorkerPool pool(PoolOptions{ 3, SchedulerMode::WorkStealing });
+    std::atomic<int> counter(0);
+    std::vector<std::future<void>> futures;
+
+    for (int i = 0; i < 10; ++i) {
+        futures.emplace_back(pool.AddTaskForExecution([&counter]() { counter++; }, [&counter]() { counter++; }));
+    }
+
+    std::for_each(futures.begin(), futures.end(), [](auto& f) { f.wait(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100)); //callbacks run after the future is set
+
+    EXPECT_EQ(pool.Mode(), SchedulerMode::WorkStealing);
+    EXPECT_EQ(counter, 20);
+}
+
+
+TEST(TaskTests, SmallCallablesAreStoredInlineTest)
+{
+    std::vector<int> nums(100, 1);
+    auto result = std::make_shared<long long>(0);
+    auto process_chunk = [](std::vector<int>::const_iterator start, std::vector<int>::const_iterator end, std::shared_ptr<long long> res) {
+        *res = std::accumulate(start, end, 0ll);
+    };
+
+    auto before = allocation_count.load();
+    {
+        //a bound function and a lambda over a chunk of an array: two iterators and a shared result
+        Task bound(std::bind(process_chunk, nums.cbegin(), nums.cend(), result));
+        Task lambda([&process_chunk, start = nums.cbegin(), end = nums.cend(), &result]() { process_chunk(start, end, result); });
+        Task moved(std::move(lambda));
+
+        EXPECT_TRUE(bound.IsStoredInline());
+        EXPECT_TRUE(moved.IsStoredInline());
+        EXPECT_FALSE(lambda);
+
+        bound();
+        moved();
+    }
+    EXPECT_EQ(allocation_count.load() - before, 0);
+    EXPECT_EQ(*result, 100);
+}
+
+TEST(TaskTests, MoveOnlyAndLargeCallablesTest)
+{
+    auto owned = std::make_unique<int>(41);
+    Task move_only([p = std::move(owned)]() { (*p)++; });
+    EXPECT_TRUE(move_only.IsStoredInline());
+    move_only();
+
+    std::array<char, 256> big_capture{};
+    Task big([big_capture]() { (void)big_capture; });
+    EXPECT_TRUE(big);
+    EXPECT_FALSE(big.IsStoredInline());
+
+    std::function<void()> empty_function;
+    EXPECT_FALSE(Task(empty_function));
+    EXPECT_FALSE(Task(static_cast<void(*)()>(nullptr)));
+}
+
+TEST(WorkerPoolTests, MoveOnlyTaskSubmissionTest)
+{
+    WorkerPool pool(2);
+    auto value = std::make_unique<int>(0);
+    std::vector<int> buffer(1000, 1);
+    std::atomic<int> counter(0);
+
+    auto fut = pool.AddTaskForExecution([p = std::move(value), buf = std::move(buffer), &counter]() {
+        counter += static_cast<int>(buf.size()) + *p;
+    });
+    fut.wait();
+
+    EXPECT_EQ(counter, 1000);
+}
+
+/*
+* Queues count tasks while every worker is held back. Records parked in the workers' caches can't be reused by an outside
+* submitter, so the pool needs about count + the cache sizes of them for the later runs to be allocation free whatever the timing
+* */
+static void WarmUpRecords(WorkerPool& pool, int count)
+{
+    std::atomic<int> held(0);
+    std::atomic<bool> gate(false);
+    for (unsigned int i = 0; i < pool.Capacity(); i++)
+        pool.Post([&] { held++; gate.wait(false); held--; });
+    while (held < static_cast<int>(pool.Capacity())) std::this_thread::yield();
+
+    std::atomic<int> done(0);
+    for (int i = 0; i < count; i++)
+        pool.Post([&done] { done++; });
+    gate = true;
+    gate.notify_all();
+    while (done < count || held > 0) std::this_thread::yield();
+}
+
+TEST(WorkerPoolTests, SubmitAllocationCountTest)
+{
+    constexpr int N = 1'000;
+
+    //the shared state of std::future is the only allocation left per submission
+    auto before = allocation_count.load();
+    {
+        std::promise<void> p;
+        auto f = p.get_future();
+    }
+    auto allocations_per_future = allocation_count.load() - before;
+
+    for (auto mode : { SchedulerMode::GlobalQueue, SchedulerMode::WorkStealing })
+    {
+        WorkerPool pool(PoolOptions{ 2, mode });
+        std::vector<std::future<void>> futures;
+        futures.reserve(N);
+        std::atomic<long long> sum(0);
+        auto run = [&] {
+            for (int i = 0; i < N; i++)
+            {
+                futures.emplace_back(pool.AddTaskForExecution([&sum, i, a = 1ll, b = 2ll, c = 3ll]() { sum += i + a + b + c; }));
+            }
+            std::for_each(futures.begin(), futures.end(), [](auto& f) { f.wait(); });
+            futures.clear();
+        };
+
+        WarmUpRecords(pool, N + 256);
+        for (int i = 0; i < 10; i++) run(); //warm up the record free lists and the queue
+        before = allocation_count.load();
+        run();
+        auto allocations = allocation_count.load() - before;
+
+        EXPECT_EQ(allocations, N * allocations_per_future);
+    }
+}
+
+TEST(WorkerPoolTests, SubmitResultAllocationTest)
+{
+    constexpr int N = 1'000;
+    for (auto mode : { SchedulerMode::GlobalQueue, SchedulerMode::WorkStealing })
+    {
+        WorkerPool pool(PoolOptions{ 2, mode });
+        std::vector<ResultHandle<long long>> results;
+        results.reserve(N);
+        long long sum = 0;
+        auto run = [&] {
+            for (int i = 0; i < N; i++)
+            {
+                results.push_back(pool.Submit([](long long a, long long b) { return a + b; }, i, 1ll));
+            }
+            for (auto& result : results) sum += result.Get();
+            results.clear();
+        };
+
+        WarmUpRecords(pool, N + 256);
+        for (int i = 0; i < 10; i++) run();
+        sum = 0;
+        auto before = allocation_count.load();
+        run();
+        //the results live in the recycled completion slots
+        EXPECT_EQ(allocation_count.load() - before, 0);
+        EXPECT_EQ(sum, static_cast<long long>(N) * (N + 1) / 2);
+    }
+}
+
+TEST(WorkerPoolTests, PostTest)
+{
+    std::atomic<int> counter(0);
+    {
+        WorkerPool pool(2);
+        for (int i = 0; i < 10; i++)
+        {
+            pool.Post([&counter] { counter++; }, [&counter] { counter++; });
+        }
+        pool.Post([] { throw std::runtime_error("swallowed"); });
+    }
+
+    EXPECT_EQ(counter, 20);
+}
+
+TEST(WorkerPoolTests, PostAllocationCountTest)
+{
+    constexpr int N = 1'000;
+
+    for (auto mode : { SchedulerMode::GlobalQueue, SchedulerMode::WorkStealing })
+    {
+        WorkerPool pool(PoolOptions{ 2, mode });
+        std::atomic<int> counter(0);
+        auto run = [&] {
+            counter = 0;
+            for (int i = 0; i < N; i++)
+            {
+                pool.Post([&counter, a = 1ll, b = 2ll, c = 3ll]() { counter++; });
+            }
+            while (counter < N) std::this_thread::yield();
+        };
+
+        WarmUpRecords(pool, N + 256);
+        for (int i = 0; i < 10; i++) run(); //warm up the record free lists and the queue
+        auto before = allocation_count.load();
+        run();
+
+        EXPECT_EQ(allocation_count.load() - before, 0);
+    }
+}
+
+TEST(WorkerPoolTests, CompletionHandleTest)
+{
+    WorkerPool pool(2);
+    std::atomic<int> counter(0);
+
+    auto handle = pool.PostWithHandle([&counter] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        counter++;
+    });
+    EXPECT_TRUE(handle.Valid());
+    handle.Wait();
+    EXPECT_TRUE(handle.IsDone());
+    EXPECT_EQ(counter, 1);
+
+    auto failing = pool.PostWithHandle([] { throw std::runtime_error("task failed"); });
+    EXPECT_THROW(failing.Wait(), std::runtime_error);
+
+    //the slots are recycled, after a warm up (filling the workers' caches) waiting on handles does not allocate
+    for (int i = 0; i < 1000; i++) pool.PostWithHandle([&counter] { counter++; }).Wait();
+    auto before = allocation_count.load();
+    for (int i = 0; i < 100; i++) pool.PostWithHandle([&counter] { counter++; }).Wait();
+    EXPECT_EQ(allocation_count.load() - before, 0);
+}
+
+TEST(WorkerPoolTests, SubmitBatchTest)
+{
+    WorkerPool pool(4);
+    std::vector<int> values(1000, 0);
+
+    auto handle = pool.SubmitBatch(values.size(), [&values](size_t i) {
+        return [&values, i] { values[i] = static_cast<int>(i); };
+    });
+    handle.Wait();
+
+    for (size_t i = 0; i < values.size(); i++)
+        EXPECT_EQ(values[i], static_cast<int>(i));
+
+    auto empty = pool.SubmitBatch(0, [](size_t) { return [] {}; });
+    EXPECT_TRUE(empty.IsDone());
+    empty.Wait();
+}
+
+TEST(WorkerPoolTests, AddTasksForExecutionRangeTest)
+{
+    WorkerPool pool(PoolOptions{ 3, SchedulerMode::WorkStealing });
+    std::atomic<int> counter(0);
+
+    //copied out of an lvalue range
+    std::vector<std::function<void()>> functions(10, [&counter] { counter++; });
+    pool.AddTasksForExecution(functions).Wait();
+    EXPECT_EQ(counter, 10);
+
+    //moved out of an rvalue range of move only tasks
+    std::vector<Task> tasks;
+    for (int i = 0; i < 10; i++)
+        tasks.emplace_back([&counter, p = std::make_unique<int>(1)] { counter += *p; });
+    pool.AddTasksForExecution(std::move(tasks)).Wait();
+    EXPECT_EQ(counter, 20);
+
+    //batch submitted from inside a worker goes to its local deque
+    pool.PostWithHandle([&pool, &counter] {
+        pool.SubmitBatch(100, [&counter](size_t) { return [&counter] { counter++; }; }).Wait();
+    }).Wait();
+    EXPECT_EQ(counter, 120);
+}
+
+TEST(WorkerPoolTests, BatchExceptionTest)
+{
+    WorkerPool pool(2);
+    std::atomic<int> counter(0);
+
+    auto handle = pool.SubmitBatch(10, [&counter](size_t i) {
+        return [&counter, i] {
+            counter++;
+            if (i == 5) throw std::runtime_error("chunk failed");
+        };
+    });
+
+    EXPECT_THROW(handle.Wait(), std::runtime_error);
+    EXPECT_EQ(counter, 10); //the other tasks still run
+}
+
+TEST(WorkerPoolTests, TypedSubmitTest)
+{
+    WorkerPool pool(2);
+
+    auto sum = pool.Submit([](int a, int b) { return a + b; }, 1, 2);
+    EXPECT_EQ(sum.Get(), 3);
+
+    //move only argument and move only result
+    auto moved = pool.Submit([](std::unique_ptr<int> p) { (*p)++; return p; }, std::make_unique<int>(41));
+    EXPECT_EQ(*moved.Get(), 42);
+
+    std::vector<int> nums(100, 2);
+    auto accumulated = pool.Submit([](const std::vector<int>& v) { return std::accumulate(v.begin(), v.end(), 0ll); }, std::move(nums));
+    EXPECT_EQ(accumulated.Get(), 200ll);
+
+    std::atomic<int> counter(0);
+    auto nothing = pool.Submit([&counter] { counter++; });
+    nothing.Get();
+    EXPECT_EQ(counter, 1);
+
+    //too big for the slot, boxed
+    auto big = pool.Submit([] { std::array<int, 64> values{}; values[63] = 7; return values; });
+    EXPECT_EQ(big.Get()[63], 7);
+
+    //references are handed back as such
+    int target = 1;
+    auto reference = pool.Submit([&target]() -> int& { return target; });
+    EXPECT_EQ(&reference.Get(), &target);
+
+    //a dropped handle still gets its result destroyed
+    auto shared = std::make_shared<int>(5);
+    pool.Submit([shared] { return shared; }).Wait();
+    EXPECT_EQ(shared.use_count(), 1);
+}
+
+TEST(WorkerPoolTests, ExceptionPropagationTest)
+{
+    WorkerPool pool(2);
+
+    auto typed = pool.Submit([]() -> int { throw std::runtime_error("typed task failed"); });
+    EXPECT_THROW(typed.Get(), std::runtime_error);
+
+    //the future of AddTaskForExecution used to be left without a value
+    auto untyped = pool.AddTaskForExecution([] { throw std::logic_error("task failed"); });
+    EXPECT_THROW(untyped.get(), std::logic_error);
+}
+
+TEST(ParallelAlgorithmsTests, ParallelForTest)
+{
+    WorkerPool pool(4);
+    std::vector<int> values(10'000, 0);
+
+    ParallelFor(pool, size_t(0), values.size(), [&values](size_t i) { values[i] = static_cast<int>(i); });
+    for (size_t i = 0; i < values.size(); i++)
+        EXPECT_EQ(values[i], static_cast<int>(i));
+
+    //iterators, the body receives the element
+    ParallelFor(pool, values.begin(), values.end(), [](int& v) { v *= 2; }, 16);
+    EXPECT_EQ(values[4'999], 9'998);
+
+    std::atomic<int> calls(0);
+    ParallelFor(pool, 5, 5, [&calls](int) { calls++; });
+    ParallelFor(pool, 5, 6, [&calls](int) { calls++; });
+    EXPECT_EQ(calls, 1);
+}
+
+TEST(ParallelAlgorithmsTests, ParallelReduceTest)
+{
+    for (auto mode : { SchedulerMode::GlobalQueue, SchedulerMode::WorkStealing })
+    {
+        WorkerPool pool(PoolOptions{ 4, mode });
+
+        for (size_t n : { 0, 1, 7, 1'000, 1'000'000 })
+        {
+            std::vector<int> nums(n);
+            std::iota(nums.begin(), nums.end(), 1);
+            auto expected = std::accumulate(nums.begin(), nums.end(), 10ll);
+
+            EXPECT_EQ(ParallelReduce(pool, nums.begin(), nums.end(), 10ll, std::plus<long long>{}), expected);
+            EXPECT_EQ(ParallelReduce(pool, nums, 10ll, std::plus<long long>{}, 1), expected);
+        }
+    }
+}
+
+TEST(ParallelAlgorithmsTests, UnbalancedWorkAndExceptionTest)
+{
+    WorkerPool pool(4);
+    std::atomic<long long> total(0);
+
+    //all the cost sits in the first elements, the pieces keep splitting while workers are idle
+    ParallelFor(pool, 0, 64, [&total](int i) {
+        if (i < 8) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        total += i;
+    }, 1);
+    EXPECT_EQ(total, 63 * 64 / 2);
+
+    EXPECT_THROW(ParallelFor(pool, 0, 100, [](int i) { if (i == 42) throw std::runtime_error("body failed"); }), std::runtime_error);
+}
+
+TEST(BoundedMpmcQueueTests, FifoAndCapacityTest)
+{
+    BoundedMpmcQueue<int> queue(3);
+    EXPECT_EQ(queue.Capacity(), 4u);
+
+    for (int i = 0; i < 4; i++)
+        EXPECT_TRUE(queue.TryPush(i));
+    EXPECT_FALSE(queue.TryPush(4));
+
+    for (int i = 0; i < 4; i++)
+        EXPECT_EQ(*queue.TryPop(), i);
+    EXPECT_FALSE(queue.TryPop().has_value());
+
+    //next lap over the same cells
+    EXPECT_TRUE(queue.TryPush(5));
+    EXPECT_EQ(*queue.TryPop(), 5);
+}
+
+TEST(BoundedMpmcQueueTests, ConcurrentProducersConsumersTest)
+{
+    constexpr int per_producer = 50'000;
+    BoundedMpmcQueue<int> queue(64);
+    std::atomic<long long> sum(0);
+    std::atomic<int> popped(0);
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < 2; p++)
+    {
+        threads.emplace_back([&queue] {
+            for (int i = 1; i <= per_producer; i++)
+                while (!queue.TryPush(i)) std::this_thread::yield();
+        });
+        threads.emplace_back([&] {
+            while (popped < 2 * per_producer)
+            {
+                if (auto item = queue.TryPop())
+                {
+                    sum += *item;
+                    popped++;
+                }
+                else std::this_thread::yield();
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    EXPECT_EQ(sum, 2ll * per_producer * (per_producer + 1) / 2);
+}
+
+TEST(WorkerPoolTests, BoundedQueueTryPostTest)
+{
+    std::atomic<bool> gate(false);
+    std::atomic<int> counter(0);
+    {
+        WorkerPool pool(PoolOptions{ 1, SchedulerMode::GlobalQueue, 2 });
+        while (!pool.AreAllWorkersAvailable()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        //keep the only worker busy, then fill the queue
+        pool.Post([&gate] { while (!gate) std::this_thread::yield(); });
+        while (pool.AreAllWorkersAvailable()) std::this_thread::yield();
+        EXPECT_TRUE(pool.TryPost([&counter] { counter++; }));
+        EXPECT_TRUE(pool.TryPost([&counter] { counter++; }));
+
+        Task rejected([&counter] { counter += 10; });
+        EXPECT_FALSE(pool.TryPost(std::move(rejected)));
+        EXPECT_TRUE(rejected); //handed back to the caller
+
+        gate = true;
+        while (!pool.TryPost(std::move(rejected))) std::this_thread::yield();
+    }
+
+    EXPECT_EQ(counter, 12);
+}
+
+TEST(WorkerPoolTests, BoundedQueueBlockAndTimeoutTest)
+{
+    std::atomic<int> counter(0);
+    {
+        //the producer blocks whenever the 4 cells are taken and keeps going as the workers drain them
+        WorkerPool pool(PoolOptions{ 2, SchedulerMode::GlobalQueue, 4, OverflowPolicy::Block });
+        for (int i = 0; i < 1'000; i++)
+        {
+            pool.Post([&counter] { counter++; });
+        }
+        pool.SubmitBatch(100, [&counter](size_t) { return [&counter] { counter++; }; }).Wait();
+    }
+    EXPECT_EQ(counter, 1'100);
+
+    std::atomic<bool> gate(false);
+    WorkerPool pool(PoolOptions{ 1, SchedulerMode::GlobalQueue, 2, OverflowPolicy::SpinWithTimeout, std::chrono::microseconds(1'000) });
+    pool.Post([&gate] { while (!gate) std::this_thread::yield(); });
+    while (pool.AreAllWorkersAvailable()) std::this_thread::yield();
+    pool.Post([] {});
+    pool.Post([] {});
+
+    EXPECT_THROW(pool.Post([] {}), std::runtime_error);
+    EXPECT_THROW((void)pool.SubmitBatch(3, [](size_t) { return [] {}; }), std::runtime_error);
+    gate = true;
+}
+
+TEST(WorkSignalTests, NoLostWakeupTest)
+{
+    for (auto strategy : { WaitStrategy::Park, WaitStrategy::SpinThenPark, WaitStrategy::Spin })
+    {
+        WorkSignal signal(strategy, 100, 2);
+        signal.Release(2); //released before anybody waits
+        signal.Acquire();
+        EXPECT_TRUE(signal.TryAcquire());
+        EXPECT_FALSE(signal.TryAcquire());
+
+        constexpr int N = 10'000;
+        std::atomic<int> acquired(0);
+        std::vector<std::thread> waiters;
+        for (int i = 0; i < 3; i++)
+        {
+            waiters.emplace_back([&] {
+                while (true)
+                {
+                    signal.Acquire();
+                    if (acquired.fetch_add(1) + 1 >= N) break;
+                }
+            });
+        }
+        for (int i = 0; i < N; i++)
+        {
+            signal.Release();
+            if (i % 100 == 0) std::this_thread::sleep_for(std::chrono::microseconds(50)); //let the waiters park
+        }
+        signal.Release(3); //the ones still waiting once the count is reached
+        for (auto& t : waiters) t.join();
+
+        EXPECT_GE(acquired, N);
+    }
+}
+
+TEST(WorkerPoolTests, WaitStrategiesTest)
+{
+    for (auto strategy : { WaitStrategy::Park, WaitStrategy::SpinThenPark, WaitStrategy::Spin })
+    {
+        std::atomic<int> counter(0);
+        {
+            PoolOptions options{ 3, SchedulerMode::WorkStealing };
+            options.wait_strategy = strategy;
+            options.spin_count = 500;
+            WorkerPool pool(options);
+
+            for (int i = 0; i < 100; i++)
+            {
+                pool.Post([&counter, &pool] {
+                    counter++;
+                    pool.Post([&counter] { counter++; });
+                });
+                if (i % 10 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            pool.AddTaskForExecution([&counter] { counter++; }).wait();
+        }
+        EXPECT_EQ(counter, 201);
+    }
+}
+
+TEST(WorkerPoolTests, PriorityLanesTest)
+{
+    PoolOptions options{ 1 };
+    options.aging_threshold = std::chrono::seconds(10);
+    WorkerPool pool(options);
+
+    //keep the only worker busy until everything is queued
+    std::atomic<bool> started(false), gate(false);
+    pool.Post([&] { started = true; started.notify_all(); gate.wait(false); });
+    started.wait(false);
+
+    std::vector<int> order;
+    for (int i = 0; i < 3; i++) pool.Post(Priority::Background, [&order, i] { order.push_back(200 + i); });
+    for (int i = 0; i < 3; i++) pool.Post([&order, i] { order.push_back(100 + i); });
+    for (int i = 0; i < 3; i++) pool.Post(Priority::High, [&order, i] { order.push_back(i); });
+    auto now = std::chrono::steady_clock::now();
+    pool.Post(now + std::chrono::hours(2), [&order] { order.push_back(-1); });
+    pool.Post(now + std::chrono::hours(1), [&order] { order.push_back(-2); });
+    auto last = pool.PostWithHandle(Priority::Background, [&order] { order.push_back(203); });
+
+    gate = true;
+    gate.notify_all();
+    last.Wait();
+
+    std::vector<int> expected{ -2, -1, 0, 1, 2, 100, 101, 102, 200, 201, 202, 203 };
+    EXPECT_EQ(order, expected);
+    EXPECT_EQ(pool.QueueTimeStats(Priority::High).count, 3u);
+    EXPECT_EQ(pool.QueueTimeStats(Priority::Normal).count, 4u);
+    EXPECT_EQ(pool.QueueTimeStats(Priority::Background).count, 4u);
+    EXPECT_EQ(pool.DeadlineQueueTimeStats().count, 2u);
+    EXPECT_EQ(pool.DeadlineMisses(), 0u);
+    EXPECT_GE(pool.QueueTimeStats(Priority::Background).Percentile(50), pool.QueueTimeStats(Priority::High).Percentile(50));
+}
+
+TEST(WorkerPoolTests, PriorityAgingAndDeadlineMissTest)
+{
+    PoolOptions options{ 1 };
+    options.aging_threshold = std::chrono::milliseconds(1);
+    WorkerPool pool(options);
+
+    std::atomic<bool> started(false), gate(false);
+    pool.Post([&] { started = true; started.notify_all(); gate.wait(false); });
+    started.wait(false);
+
+    std::atomic<int> high_done(0);
+    int high_done_before_background = -1;
+    auto background = pool.PostWithHandle(Priority::Background, [&] { high_done_before_background = high_done; });
+    std::vector<CompletionHandle> high;
+    for (int i = 0; i < 20; i++)
+        high.push_back(pool.PostWithHandle(Priority::High, [&high_done] { std::this_thread::sleep_for(std::chrono::microseconds(500)); high_done++; }));
+    auto missed = pool.PostWithHandle(std::chrono::steady_clock::now(), [] {});
+
+    //the background task has been waiting for longer than the aging threshold by the time the worker is free
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    gate = true;
+    gate.notify_all();
+    background.Wait();
+    for (auto& h : high) h.Wait();
+    missed.Wait();
+
+    EXPECT_LT(high_done_before_background, 20);
+    EXPECT_EQ(pool.DeadlineMisses(), 1u);
+}
+
+TEST(WorkerPoolTests, ElasticGrowAndRetireTest)
+{
+    PoolOptions options{ 1 };
+    options.max_threads = 4;
+    options.idle_timeout = std::chrono::milliseconds(20);
+    WorkerPool pool(options);
+    EXPECT_EQ(pool.Capacity(), 4u);
+    EXPECT_EQ(pool.ThreadCount(), 1u);
+
+    //every task waits for all four to be running at once, which only happens if the pool grows
+    std::atomic<int> running(0);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    std::vector<std::future<void>> futures;
+    for (int i = 0; i < 4; i++)
+    {
+        futures.push_back(pool.AddTaskForExecution([&] {
+            running++;
+            while (running < 4 && std::chrono::steady_clock::now() < deadline) std::this_thread::yield();
+        }));
+    }
+    for (auto& f : futures) f.wait();
+    EXPECT_EQ(running, 4);
+    EXPECT_EQ(pool.ThreadCount(), 4u);
+
+    //idle threads retire down to min_threads
+    while (pool.ThreadCount() > 1 && std::chrono::steady_clock::now() < deadline) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_EQ(pool.ThreadCount(), 1u);
+    pool.AddTaskForExecution([&running] { running++; }).wait();
+    EXPECT_EQ(running, 5);
+
+    //once the only worker is stuck no task starts and no submit sees a backlog, the growth watch adds a thread anyway
+    PoolOptions stuck_options{ 1 };
+    stuck_options.max_threads = 2;
+    stuck_options.growth_backlog = 1'000;
+    WorkerPool stuck_pool(stuck_options);
+    std::atomic<bool> release(false);
+    std::atomic<bool> blocking(false);
+    auto blocked = stuck_pool.AddTaskForExecution([&] {
+        blocking = true;
+        while (!release) std::this_thread::yield();
+    });
+    while (!blocking) std::this_thread::yield();
+    stuck_pool.AddTaskForExecution([&release] { release = true; }).wait();
+    blocked.wait();
+    EXPECT_EQ(stuck_pool.ThreadCount(), 2u);
+}
+
+TEST(WorkerPoolTests, ThreadStartTest)
+{
+    for (auto start : { ThreadStart::Eager, ThreadStart::Parallel, ThreadStart::Lazy })
+    {
+        for (bool reuse : { false, true })
+        {
+            PoolOptions options{ 13 };
+            options.thread_start = start;
+            options.reuse_threads = reuse;
+            {
+                WorkerPool pool(options);
+                if (start == ThreadStart::Lazy)
+                {
+                    EXPECT_EQ(pool.ThreadCount(), 0u);
+                    EXPECT_FALSE(pool.IsReady());
+                }
+                pool.WaitUntilReady();
+                EXPECT_TRUE(pool.IsReady());
+                EXPECT_EQ(pool.ThreadCount(), 13u);
+                EXPECT_TRUE(pool.AreAllWorkersAvailable());
+
+                std::atomic<int> done(0);
+                pool.SubmitBatch(100, [&done](size_t) { return [&done] { done++; }; }).Wait();
+                EXPECT_EQ(done, 100);
+                pool.Resize(3);
+            }
+            if (reuse)
+            {
+                EXPECT_GE(ThreadCache::Instance().ParkedCount(), 13u);
+            }
+        }
+    }
+
+    //the first submission starts a lazy pool, Resize does too
+    PoolOptions options{ 4 };
+    options.thread_start = ThreadStart::Lazy;
+    WorkerPool lazy(options);
+    EXPECT_EQ(lazy.ThreadCount(), 0u);
+    lazy.AddTaskForExecution([] {}).wait();
+    EXPECT_EQ(lazy.ThreadCount(), 4u);
+    WorkerPool resized(options);
+    resized.Resize(2);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (resized.ThreadCount() != 2 && std::chrono::steady_clock::now() < deadline) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_EQ(resized.ThreadCount(), 2u);
+    ThreadCache::Instance().Trim();
+    EXPECT_EQ(ThreadCache::Instance().ParkedCount(), 0u);
+}
+
+TEST(WorkerPoolTests, ResizeTest)
+{
+    WorkerPool pool(4);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    auto wait_for_threads = [&](unsigned int count) {
+        while (pool.ThreadCount() != count && std::chrono::steady_clock::now() < deadline) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return pool.ThreadCount();
+    };
+
+    pool.Resize(2);
+    EXPECT_EQ(wait_for_threads(2), 2u);
+    pool.Resize(8); //clamped to Capacity()
+    EXPECT_EQ(wait_for_threads(4), 4u);
+
+    //shrink and grow back while tasks are flowing
+    std::atomic<int> counter(0);
+    for (int round = 0; round < 20; round++)
+    {
+        pool.Resize(round % 2 ? 4 : 1);
+        for (int i = 0; i < 50; i++) pool.Post([&counter] { counter++; });
+    }
+    pool.AddTaskForExecution([&counter] { counter++; }).wait();
+    EXPECT_EQ(wait_for_threads(4), 4u);
+    while (counter < 1001 && std::chrono::steady_clock::now() < deadline) std::this_thread::yield();
+    EXPECT_EQ(counter, 1001);
+
+    std::vector<int> values(1000, 1);
+    EXPECT_EQ(ParallelReduce(pool, values, 0, std::plus<>()), 1000);
+}
+
+TEST(WorkerPoolTests, NumaNodeQueuesTest)
+{
+    PoolOptions options{ 2 };
+    options.numa_aware = true;
+    options.numa_nodes = { { 0 }, { 0 } }; //two nodes sharing a cpu, enough to exercise the per node queues anywhere
+    WorkerPool pool(options);
+    ASSERT_EQ(pool.NodeCount(), 2u);
+    EXPECT_EQ(pool.NodeOfWorker(0), 0u);
+    EXPECT_EQ(pool.NodeOfWorker(1), 1u);
+
+    //hold both workers, each on its own gate
+    std::atomic<int> held(0);
+    std::array<std::atomic<bool>, 2> gates{};
+    for (int i = 0; i < 2; i++)
+        pool.Post([&] { auto index = pool.CurrentWorkerIndex(); held++; gates[index].wait(false); held--; });
+    while (held < 2) std::this_thread::yield();
+
+    std::mutex mx;
+    std::vector<std::pair<unsigned int, int>> executed; //target node, executing worker
+    std::vector<CompletionHandle> handles;
+    for (unsigned int node : { 1u, 0u, 1u, 0u, 1u, 0u })
+    {
+        handles.push_back(pool.PostWithHandle(NumaNode{ node }, [&, node] {
+            std::lock_guard lk(mx);
+            executed.emplace_back(node, pool.CurrentWorkerIndex());
+        }));
+    }
+
+    //only worker 0 runs: its own node's tasks come first, then it takes over the remote ones rather than idling
+    gates[0] = true;
+    gates[0].notify_all();
+    for (auto& h : handles) h.Wait();
+    gates[1] = true;
+    gates[1].notify_all();
+    while (held > 0) std::this_thread::yield();
+
+    ASSERT_EQ(executed.size(), 6u);
+    for (size_t i = 0; i < executed.size(); i++)
+    {
+        EXPECT_EQ(executed[i].first, i < 3 ? 0u : 1u);
+        EXPECT_EQ(executed[i].second, 0);
+    }
+}
+
+TEST(WorkerPoolTests, PinnedWorkersTest)
+{
+    PoolOptions options{ 2 };
+    options.pin_workers = true;
+    options.cpu_sets = { { 0 } };
+    WorkerPool pool(options);
+
+    std::atomic<int> on_cpu0(0);
+    auto handle = pool.SubmitBatch(10, [&](size_t) {
+        return [&on_cpu0] {
+#ifdef __linux__
+            if (sched_getcpu() == 0) on_cpu0++;
+#else
+            on_cpu0++;
+#endif
+        };
+    });
+    handle.Wait();
+    EXPECT_EQ(on_cpu0, 10);
+}
+
+TEST(TaskGraphTests, DependenciesTest)
+{
+    WorkerPool pool(4);
+    TaskGraph graph;
+
+    //diamond a -> (b, c) -> d, plus a fan-in of 20 nodes into e after d
+    std::atomic<int> step(0);
+    int a_at = -1, b_at = -1, c_at = -1, d_at = -1, e_at = -1;
+    auto a = graph.AddNode([&] { a_at = step++; });
+    auto b = graph.AddNode([&] { b_at = step++; });
+    auto c = graph.AddNode([&] { c_at = step++; });
+    auto d = graph.AddNode([&] { d_at = step++; });
+    auto e = graph.AddNode([&] { e_at = step++; });
+    graph.AddEdge(a, b);
+    graph.AddEdge(a, c);
+    graph.AddEdge(b, d);
+    graph.AddEdge(c, d);
+    std::atomic<int> fan_in(0);
+    for (int i = 0; i < 20; i++)
+    {
+        auto n = graph.AddNode([&fan_in] { fan_in++; });
+        graph.AddEdge(d, n);
+        graph.AddEdge(n, e);
+    }
+    EXPECT_THROW(graph.AddEdge(a, 100), std::out_of_range);
+
+    std::atomic<bool> done_called(false);
+    for (int run = 0; run < 3; run++)
+    {
+        step = 0;
+        fan_in = 0;
+        done_called = false;
+        graph.Run(pool, [&done_called] { done_called = true; });
+        graph.Wait();
+
+        EXPECT_EQ(a_at, 0);
+        EXPECT_GT(b_at, a_at);
+        EXPECT_GT(c_at, a_at);
+        EXPECT_GT(d_at, std::max(b_at, c_at));
+        EXPECT_EQ(e_at, 4);
+        EXPECT_EQ(fan_in, 20);
+        EXPECT_TRUE(done_called);
+    }
+
+    //reruns reuse the nodes and the pool's records, nothing is allocated
+    WarmUpRecords(pool, 1'000);
+    auto before = allocation_count.load();
+    graph.Run(pool);
+    graph.Wait();
+    EXPECT_EQ(allocation_count.load() - before, 0);
+
+    //a graph polled until done can be destroyed right away, the node which finished it may still be on its way out
+    std::atomic<int> runs(0);
+    for (int i = 0; i < 2'000; i++)
+    {
+        auto short_lived = std::make_unique<TaskGraph>();
+        short_lived->AddNode([&runs] { runs++; });
+        short_lived->Run(pool);
+        while (!short_lived->IsDone()) std::this_thread::yield();
+    }
+    EXPECT_EQ(runs, 2'000);
+}
+
+TEST(TaskGraphTests, ErrorsTest)
+{
+    WorkerPool pool(2);
+
+    TaskGraph cyclic;
+    auto x = cyclic.AddNode([] {});
+    auto y = cyclic.AddNode([] {});
+    cyclic.AddEdge(x, y);
+    cyclic.AddEdge(y, x);
+    EXPECT_THROW(cyclic.Run(pool), std::logic_error);
+
+    //a failing node skips the ones which haven't started, the exception comes out of Wait
+    TaskGraph graph;
+    std::atomic<int> ran(0);
+    auto first = graph.AddNode([] { throw std::runtime_error("node failed"); });
+    auto second = graph.AddNode([&ran] { ran++; });
+    graph.AddEdge(first, second);
+    graph.Run(pool);
+    EXPECT_THROW(graph.Wait(), std::runtime_error);
+    EXPECT_EQ(ran, 0);
+
+    //an empty graph is done right away
+    TaskGraph empty;
+    empty.Run(pool);
+    EXPECT_TRUE(empty.IsDone());
+}
+
+TEST(TaskGraphTests, NestedRunTest)
+{
+    //a node starting another graph does not block a worker, the pool can be smaller than the nesting
+    WorkerPool pool(1);
+    TaskGraph inner;
+    std::atomic<int> inner_runs(0);
+    inner.AddNode([&inner_runs] { inner_runs++; });
+
+    TaskGraph outer;
+    std::atomic<bool> finished(false);
+    auto start = outer.AddNode([&] { inner.Run(pool, [&finished] { finished = true; finished.notify_all(); }); });
+    auto after = outer.AddNode([] {});
+    outer.AddEdge(start, after);
+    outer.Run(pool);
+    outer.Wait();
+    finished.wait(false);
+    inner.Wait();
+    EXPECT_EQ(inner_runs, 1);
+}
+
+static ms::task<int> SquareOnPool(WorkerPool& pool, int value, std::thread::id caller, std::atomic<int>& on_worker)
+{
+    co_await pool.Schedule();
+    if (std::this_thread::get_id() != caller)
+        on_worker++;
+    co_return value * value;
+}
+
+static ms::task<int> SumOfSquares(WorkerPool& pool, int count, std::atomic<int>& on_worker)
+{
+    int sum = 0;
+    for (int i = 1; i <= count; i++)
+    {
+        sum += co_await SquareOnPool(pool, i, std::this_thread::get_id(), on_worker);
+    }
+    co_return sum;
+}
+
+TEST(CoroutineTests, ScheduleAndTaskTest)
+{
+    WorkerPool pool(2);
+    std::atomic<int> on_worker(0);
+    EXPECT_EQ(SyncWait(SumOfSquares(pool, 10, on_worker)), 385);
+    //the first square is awaited from the test thread, the rest from the worker which ran the previous one
+    EXPECT_GE(on_worker, 1);
+
+    auto throwing = [](WorkerPool& pool) -> ms::task<> {
+        co_await pool.Schedule();
+        throw std::runtime_error("coroutine failed");
+    };
+    EXPECT_THROW(SyncWait(throwing(pool)), std::runtime_error);
+}
+
+TEST(CoroutineTests, WhenAllWhenAnyTest)
+{
+    //outlives the pool, the slow task below is still reading it when the test is over
+    std::atomic<bool> release(false);
+    WorkerPool pool(4);
+    std::atomic<int> on_worker(0);
+    std::vector<ms::task<int>> squares;
+    for (int i = 0; i < 100; i++)
+    {
+        squares.push_back(SquareOnPool(pool, i, std::this_thread::get_id(), on_worker));
+    }
+    auto results = SyncWait(WhenAll(std::move(squares)));
+    ASSERT_EQ(results.size(), 100u);
+    for (int i = 0; i < 100; i++)
+    {
+        EXPECT_EQ(results[i], i * i);
+    }
+    EXPECT_EQ(on_worker, 100);
+
+    std::atomic<int> finished(0);
+    auto count_when_done = [](WorkerPool& pool, std::atomic<int>& finished) -> ms::task<> {
+        co_await pool.Schedule();
+        finished++;
+    };
+    std::vector<ms::task<>> counters;
+    for (int i = 0; i < 10; i++)
+    {
+        counters.push_back(count_when_done(pool, finished));
+    }
+    SyncWait(WhenAll(std::move(counters)));
+    EXPECT_EQ(finished, 10);
+
+    //the task finishing first wins, the slow one is still running when WhenAny completes
+    auto slow = [](WorkerPool& pool, std::atomic<bool>& release) -> ms::task<int> {
+        co_await pool.Schedule();
+        release.wait(false);
+        co_return 1;
+    };
+    auto fast = [](WorkerPool& pool) -> ms::task<int> {
+        co_await pool.Schedule();
+        co_return 2;
+    };
+    std::vector<ms::task<int>> racing;
+    racing.push_back(slow(pool, release));
+    racing.push_back(fast(pool));
+    auto [index, value] = SyncWait(WhenAny(std::move(racing)));
+    EXPECT_EQ(index, 1u);
+    EXPECT_EQ(value, 2);
+    release = true;
+    release.notify_all();
+
+    EXPECT_THROW(SyncWait(WhenAny(std::vector<ms::task<int>>{})), std::invalid_argument);
+}
+
+TEST(CoroutineTests, ScheduleAllocationCountTest)
+{
+    //resuming on a worker queues the coroutine handle itself, no callable wrapper is allocated
+    WorkerPool pool(2);
+    WarmUpRecords(pool, 1000);
+    auto hop = [](WorkerPool& pool, int hops) -> ms::task<int> {
+        for (int i = 0; i < hops; i++)
+        {
+            co_await pool.Schedule();
+        }
+        co_return hops;
+    };
+    auto t = hop(pool, 1000);
+    auto before = allocation_count.load();
+    EXPECT_EQ(SyncWait(std::move(t)), 1000);
+    //only SyncWait's own frame
+    EXPECT_LE(allocation_count.load() - before, 1);
+}
+
+TEST(WorkerPoolTests, StatsTest)
+{
+    WorkerPool pool(2);
+    while (!pool.AreAllWorkersAvailable()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    auto stats = pool.Stats();
+    EXPECT_EQ(stats.tasks_submitted, 0u);
+    EXPECT_EQ(stats.threads, 2u);
+    ASSERT_EQ(stats.workers.size(), 2u);
+    EXPECT_TRUE(stats.workers[0].running && stats.workers[0].idle);
+
+    //both workers held, the next tasks stay queued
+    std::atomic<bool> gate(false);
+    std::atomic<int> held(0);
+    std::vector<CompletionHandle> handles;
+    for (int i = 0; i < 2; i++)
+    {
+        handles.push_back(pool.PostWithHandle([&] { held++; gate.wait(false); std::this_thread::sleep_for(std::chrono::milliseconds(5)); }));
+    }
+    while (held < 2) std::this_thread::yield();
+    for (int i = 0; i < 10; i++)
+    {
+        handles.push_back(pool.PostWithHandle([] {}));
+    }
+    handles.push_back(pool.PostWithHandle([] { throw std::runtime_error("task failed"); }));
+
+    stats = pool.Stats();
+    EXPECT_EQ(stats.tasks_submitted, 13u);
+    EXPECT_EQ(stats.queue_depth, 11u);
+    EXPECT_EQ(stats.tasks_running, 2u);
+    EXPECT_FALSE(stats.workers[0].idle || stats.workers[1].idle);
+
+    gate = true;
+    gate.notify_all();
+    for (auto& handle : handles)
+    {
+        try { handle.Wait(); } catch (const std::runtime_error&) {}
+    }
+    //the counters are bumped right after the handle is signalled
+    for (auto start = std::chrono::steady_clock::now(); pool.Stats().tasks_completed < 13 && std::chrono::steady_clock::now() - start < std::chrono::seconds(5);)
+        std::this_thread::yield();
+
+    stats = pool.Stats();
+    EXPECT_EQ(stats.tasks_completed, 13u);
+    EXPECT_EQ(stats.tasks_failed, 1u);
+    EXPECT_EQ(stats.queue_depth, 0u);
+    EXPECT_EQ(stats.queue_time.count, 13u);
+    EXPECT_EQ(stats.execution_time.count, 13u);
+    EXPECT_GE(stats.execution_time.Max(), std::chrono::milliseconds(5));
+    EXPECT_EQ(stats.workers[0].tasks_executed + stats.workers[1].tasks_executed, 13u);
+    EXPECT_GE(stats.workers[0].busy_time + stats.workers[1].busy_time, std::chrono::milliseconds(10));
+    EXPECT_GT(stats.workers[0].idle_time + stats.workers[1].idle_time, std::chrono::nanoseconds(0));
+}
+
+TEST(WorkerPoolTests, BatchedDequeueTest)
+{
+    //a single worker moving batches to its deque still runs the tasks in submission order
+    {
+        std::atomic<bool> gate(false);
+        WorkerPool pool(1);
+        pool.Post([&gate] { gate.wait(false); });
+        std::vector<int> order;
+        std::vector<CompletionHandle> handles;
+        for (int i = 0; i < 1000; i++)
+        {
+            handles.push_back(pool.PostWithHandle([&order, i] { order.push_back(i); }));
+        }
+        gate = true;
+        gate.notify_all();
+        for (auto& handle : handles) handle.Wait();
+        std::vector<int> expected(1000);
+        std::iota(expected.begin(), expected.end(), 0);
+        EXPECT_EQ(order, expected);
+    }
+
+    //the tasks batched by a worker which then blocks are stolen by the other one
+    for (auto mode : { SchedulerMode::GlobalQueue, SchedulerMode::WorkStealing })
+    {
+        std::atomic<bool> hold(false), release(false);
+        std::atomic<int> held(0), counter(0);
+        WorkerPool pool(PoolOptions{ 2, mode });
+        for (int i = 0; i < 2; i++)
+        {
+            pool.Post([&] { held++; hold.wait(false); });
+        }
+        while (held < 2) std::this_thread::yield();
+
+        pool.Post([&release] { release.wait(false); });
+        for (int i = 0; i < 100; i++)
+        {
+            pool.Post([&counter] { counter++; });
+        }
+        hold = true;
+        hold.notify_all();
+        for (auto start = std::chrono::steady_clock::now(); counter < 100 && std::chrono::steady_clock::now() - start < std::chrono::seconds(5);)
+            std::this_thread::yield();
+        EXPECT_EQ(counter, 100);
+        release = true;
+        release.notify_all();
+    }
+}
+
+static long long ForkJoinFib(WorkerPool& pool, int n)
+{
+    if (n < 2) return n;
+    long long a = 0, b = 0;
+    TaskGroup group(pool);
+    group.Run([&pool, &a, n] { a = ForkJoinFib(pool, n - 1); });
+    b = ForkJoinFib(pool, n - 2);
+    group.Wait();
+    return a + b;
+}
+
+TEST(TaskGroupTests, RecursiveForkJoinTest)
+{
+    //every level waits on the one below from inside a task, a blocking wait would run out of workers right away
+    for (auto mode : { SchedulerMode::GlobalQueue, SchedulerMode::WorkStealing })
+    {
+        for (unsigned int threads : { 1u, 2u, 4u })
+        {
+            WorkerPool pool(PoolOptions{ threads, mode });
+            std::promise<long long> result;
+            pool.Post([&] { result.set_value(ForkJoinFib(pool, 18)); });
+            EXPECT_EQ(result.get_future().get(), 2584);
+        }
+    }
+
+    //nested loops on a single worker
+    WorkerPool pool(1);
+    std::atomic<int> total(0);
+    pool.PostWithHandle([&] {
+        ParallelFor(pool, 0, 8, [&](int) { ParallelFor(pool, 0, 100, [&](int i) { total += i; }, 1); }, 1);
+    }).Wait();
+    EXPECT_EQ(total, 8 * 4950);
+}
+
+TEST(TaskGroupTests, WaitAndExceptionTest)
+{
+    WorkerPool pool(2);
+    std::atomic<int> counter(0);
+    TaskGroup group(pool);
+
+    //waited on from outside the pool
+    for (int i = 0; i < 100; i++)
+    {
+        group.Run([&counter] { counter++; });
+    }
+    group.Wait();
+    EXPECT_EQ(counter, 100);
+    EXPECT_TRUE(group.IsDone());
+
+    group.Run([] { throw std::runtime_error("forked task failed"); });
+    group.Run([&counter] { counter++; });
+    EXPECT_THROW(group.Wait(), std::runtime_error);
+    EXPECT_EQ(counter, 101);
+
+    //reusable once the error is reported
+    group.Run([&counter] { counter++; });
+    EXPECT_NO_THROW(group.Wait());
+    EXPECT_EQ(counter, 102);
+
+    //destroyed as soon as Wait returns, while the last task may still be on its way out (the sanitizers watch the rest)
+    for (int i = 0; i < 2'000; i++)
+    {
+        auto short_lived = std::make_unique<TaskGroup>(pool);
+        short_lived->Run([&counter] { counter++; });
+        short_lived->Wait();
+    }
+    EXPECT_EQ(counter, 2'102);
+}
+
+//forwards to the heap, counting the calls and the bytes held
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+    std::atomic<int> allocations{ 0 };
+    std::atomic<long long> outstanding{ 0 };
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        allocations++;
+        outstanding += static_cast<long long>(bytes);
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        outstanding -= static_cast<long long>(bytes);
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
+
+TEST(WorkerPoolTests, MemoryResourceTest)
+{
+    constexpr int N = 1'000;
+    CountingResource resource;
+    {
+        PoolOptions options{ 2 };
+        options.memory_resource = &resource;
+        WorkerPool pool(options);
+
+        //records and completion slots come in slabs
+        std::atomic<int> counter(0);
+        for (int i = 0; i < N; i++)
+        {
+            pool.Post([&counter] { counter++; });
+        }
+        pool.PostWithHandle([&counter] { counter++; }).Wait();
+        while (counter < N + 1) std::this_thread::yield();
+        auto slabs = resource.allocations.load();
+        EXPECT_GT(slabs, 0);
+        EXPECT_LE(slabs, N / 16);
+
+        //so do the promises, one per call
+        auto before = resource.allocations.load();
+        pool.AddTaskForExecution([] {}).wait();
+        EXPECT_EQ(pool.Submit([](int a) { return a * 2; }, 21).Get(), 42);
+        EXPECT_GE(resource.allocations - before, 2);
+    }
+    EXPECT_EQ(resource.outstanding, 0);
+
+    //without recycling every record and slot is allocated for its task and given back afterwards
+    {
+        PoolOptions options{ 2 };
+        options.memory_resource = &resource;
+        options.recycle_records = false;
+        WorkerPool pool(options);
+        auto before = resource.allocations.load();
+        for (int i = 0; i < N; i++)
+        {
+            EXPECT_EQ(pool.Submit([](int a) { return a * 2; }, i).Get(), i * 2);
+        }
+        EXPECT_GE(resource.allocations - before, 2 * N);
+    }
+    EXPECT_EQ(resource.outstanding, 0);
+}
+
+TEST(StrandTests, OrderAndExclusionTest)
+{
+    constexpr int strands = 64, producers = 4, per_producer = 500;
+    struct Stream
+    {
+        std::atomic<int> running{ 0 };
+        std::atomic<bool> overlapped{ false };
+        std::array<int, producers> last{};
+        bool in_order = true;
+        int count = 0;
+    };
+
+    for (auto mode : { SchedulerMode::GlobalQueue, SchedulerMode::WorkStealing })
+    {
+        std::vector<Stream> streams(strands);
+        WorkerPool pool(PoolOptions{ 4, mode });
+        {
+            std::vector<std::unique_ptr<Strand>> strand_list;
+            for (int s = 0; s < strands; s++)
+                strand_list.push_back(std::make_unique<Strand>(pool));
+
+            std::vector<std::thread> threads;
+            for (int p = 0; p < producers; p++)
+            {
+                threads.emplace_back([&, p] {
+                    for (int i = 1; i <= per_producer; i++)
+                    {
+                        auto s = (i * 7 + p) % strands;
+                        strand_list[s]->Post([&stream = streams[s], &strand = *strand_list[s], p, i] {
+                            if (stream.running.fetch_add(1) != 0 || !strand.RunningInThisThread())
+                                stream.overlapped = true;
+                            //plain members, the strand alone keeps them consistent
+                            if (stream.last[p] >= i)
+                                stream.in_order = false;
+                            stream.last[p] = i;
+                            stream.count++;
+                            stream.running.fetch_sub(1);
+                        });
+                    }
+                });
+            }
+            for (auto& t : threads) t.join();
+        }
+
+        int total = 0;
+        for (auto& stream : streams)
+        {
+            EXPECT_FALSE(stream.overlapped);
+            EXPECT_TRUE(stream.in_order);
+            total += stream.count;
+        }
+        EXPECT_EQ(total, producers * per_producer);
+    }
+}
+
+TEST(StrandTests, PostFromStrandTaskTest)
+{
+    WorkerPool pool(2);
+    std::vector<int> order;
+    {
+        Strand strand(pool);
+        //tasks posted from a strand task queue behind it, the strand never waits on itself
+        for (int i = 0; i < 100; i++)
+        {
+            strand.Post([&strand, &order, i] {
+                order.push_back(i);
+                strand.Post([&order, i] { order.push_back(1'000 + i); });
+            });
+        }
+    }
+    ASSERT_EQ(order.size(), 200u);
+    std::vector<int> first, second;
+    for (auto v : order)
+        (v < 1'000 ? first : second).push_back(v);
+    std::vector<int> expected(100);
+    std::iota(expected.begin(), expected.end(), 0);
+    EXPECT_EQ(first, expected);
+    std::iota(expected.begin(), expected.end(), 1'000);
+    EXPECT_EQ(second, expected);
+    //and the task posted by i comes after i
+    for (int i = 0; i < 100; i++)
+        EXPECT_LT(std::find(order.begin(), order.end(), i), std::find(order.begin(), order.end(), 1'000 + i));
+
+    //destroyed as soon as it is idle, while the drainer of its last task may still be on its way out
+    std::atomic<int> runs(0);
+    for (int i = 0; i < 2'000; i++)
+    {
+        auto short_lived = std::make_unique<Strand>(pool);
+        short_lived->Post([&runs] { runs++; });
+        while (!short_lived->IsIdle()) std::this_thread::yield();
+    }
+    EXPECT_EQ(runs, 2'000);
+}
+
+TEST(StrandTests, BusyStrandFairnessTest)
+{
+    //one worker, which pops its own deque first: a strand that never runs dry must not keep the tasks queued there waiting
+    PoolOptions options{ 1 };
+    options.mode = SchedulerMode::WorkStealing;
+    WorkerPool pool(options);
+    std::atomic<int> unrelated(0);
+    std::atomic<bool> stop(false);
+    bool timed_out = false;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    {
+        Strand strand(pool);
+        std::function<void()> busy = [&] {
+            if (std::chrono::steady_clock::now() >= deadline)
+                timed_out = true;
+            else if (!stop)
+                strand.Post([&busy] { busy(); });
+        };
+        pool.AddTaskForExecution([&] {
+            for (int i = 0; i < 10; i++)
+                pool.Post([&] { if (++unrelated == 10) stop = true; });
+            strand.Post([&busy] { busy(); });
+        }).wait();
+        while (!stop && std::chrono::steady_clock::now() < deadline) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(unrelated, 10);
+    EXPECT_FALSE(timed_out);
+}
+
+TEST(TimerTests, TimerWheelTest)
+{
+    //due ticks on every level, across level boundaries and past the top one (overflow)
+    std::vector<int64_t> dues{ 1, 2, 63, 64, 65, 100, 4'095, 4'096, 4'097, 262'143, 262'144, 300'000, (int64_t(1) << 30) - 1, int64_t(1) << 30, (int64_t(1) << 30) + 5, (int64_t(1) << 36) + 7 };
+    std::mt19937_64 random(42);
+    for (int i = 0; i < 1'000; i++)
+        dues.push_back(static_cast<int64_t>(random() % (int64_t(1) << 32)) + 1);
+
+    TimerWheel wheel;
+    std::vector<TimerEntry> entries(dues.size());
+    for (size_t i = 0; i < dues.size(); i++)
+    {
+        entries[i].due = dues[i];
+        wheel.Insert(&entries[i]);
+    }
+    //a removed one never fires
+    wheel.Remove(&entries[5]);
+    EXPECT_EQ(wheel.Size(), dues.size() - 1);
+
+    std::vector<int64_t> fired;
+    bool on_time = true;
+    for (int64_t target : { int64_t(0), int64_t(64), int64_t(5'000), int64_t(1) << 31, int64_t(1) << 40 })
+    {
+        wheel.Advance(target, [&](TimerEntry* entry) {
+            on_time = on_time && entry->due == wheel.Current();
+            fired.push_back(entry->due);
+        });
+        EXPECT_EQ(wheel.Current(), target);
+    }
+    EXPECT_TRUE(on_time);
+    EXPECT_EQ(wheel.Size(), 0u);
+    EXPECT_EQ(wheel.NextEventTick(), TimerWheel::no_event);
+
+    dues.erase(dues.begin() + 5);
+    std::sort(dues.begin(), dues.end());
+    EXPECT_EQ(fired, dues);
+}
+
+TEST(TimerTests, DelayedAndCancelledTest)
+{
+    using namespace std::chrono;
+    WorkerPool pool(2);
+    std::mutex mx;
+    std::vector<int> order;
+    std::atomic<bool> early(false);
+    auto start = steady_clock::now();
+    for (int delay : { 30, 10, 20 })
+    {
+        pool.AddTaskAfter(milliseconds(delay), [&, delay] {
+            if (steady_clock::now() - start < milliseconds(delay)) early = true;
+            std::unique_lock lk(mx);
+            order.push_back(delay);
+        });
+    }
+    std::atomic<bool> cancelled_ran(false);
+    auto cancelled = pool.AddTaskAt(start + milliseconds(15), [&cancelled_ran] { cancelled_ran = true; });
+    EXPECT_TRUE(pool.CancelTimer(cancelled));
+    EXPECT_FALSE(pool.CancelTimer(cancelled));
+
+    while (pool.PendingTimers() > 0) std::this_thread::sleep_for(milliseconds(1));
+    std::this_thread::sleep_for(milliseconds(20));
+    std::unique_lock lk(mx);
+    EXPECT_EQ(order, (std::vector<int>{ 10, 20, 30 }));
+    EXPECT_FALSE(early);
+    EXPECT_FALSE(cancelled_ran);
+    EXPECT_FALSE(pool.CancelTimer(TimerHandle{}));
+}
+
+TEST(TimerTests, PeriodicAndManyTimersTest)
+{
+    using namespace std::chrono;
+    WorkerPool pool(2);
+
+    std::atomic<int> ticks(0);
+    auto periodic = pool.AddPeriodicTask(milliseconds(2), [&ticks] { ticks++; });
+    while (ticks < 5) std::this_thread::sleep_for(milliseconds(1));
+    EXPECT_TRUE(pool.CancelTimer(periodic));
+    std::this_thread::sleep_for(milliseconds(10));
+    auto after_cancel = ticks.load();
+    std::this_thread::sleep_for(milliseconds(20));
+    EXPECT_EQ(ticks, after_cancel);
+
+    //no thread per timer, every other one cancelled
+    constexpr int N = 100'000;
+    std::atomic<int> fired(0);
+    std::vector<TimerHandle> handles;
+    handles.reserve(N);
+    for (int i = 0; i < N; i++)
+        handles.push_back(pool.AddTaskAfter(milliseconds(50 + i % 100), [&fired] { fired++; }));
+    int cancelled = 0;
+    for (int i = 0; i < N; i += 2)
+        cancelled += pool.CancelTimer(handles[i]);
+    while (pool.PendingTimers() > 0) std::this_thread::sleep_for(milliseconds(5));
+    while (fired < N - cancelled) std::this_thread::yield();
+    //the ones which were already due when their turn to be cancelled came have run
+    EXPECT_GT(cancelled, 0);
+    EXPECT_EQ(fired, N - cancelled);
+}
+
+//temporary file for the I/O tests, removed on destruction
+struct TempFile
+{
+    std::filesystem::path path = std::filesystem::temp_directory_path() / ("workerpool_io_" + std::to_string(std::random_device{}()));
+    AsyncFileIo::NativeFile file;
+
+    TempFile()
+    {
+#if defined(_WIN32)
+        file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+        file = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+#endif
+    }
+
+    ~TempFile()
+    {
+#if defined(_WIN32)
+        CloseHandle(file);
+#else
+        ::close(file);
+#endif
+        std::filesystem::remove(path);
+    }
+};
+
+TEST(AsyncFileTests, WriteReadFsyncTest)
+{
+    constexpr size_t chunk = 4'096, chunks = 64;
+    WorkerPool pool(2);
+    for (auto backend : { IoBackend::Auto, IoBackend::Threads })
+    {
+        AsyncFileIo io(pool, IoOptions{ backend, 8 });
+        EXPECT_TRUE(backend == IoBackend::Threads ? io.Backend() == IoBackend::Threads : io.Backend() != IoBackend::Auto);
+        TempFile temp;
+
+        std::vector<char> data(chunk * chunks);
+        for (size_t i = 0; i < data.size(); i++)
+            data[i] = static_cast<char>(i * 31 % 251);
+
+        //more operations than the queue depth, completing on the workers in any order
+        std::atomic<size_t> written(0);
+        std::atomic<int> done(0);
+        std::atomic<bool> on_worker(true);
+        for (size_t c = 0; c < chunks; c++)
+        {
+            io.Write(temp.file, data.data() + c * chunk, chunk, c * chunk, [&](IoResult result) {
+                if (pool.CurrentWorkerIndex() < 0) on_worker = false;
+                if (result) written += result.bytes;
+                done++;
+            });
+        }
+        while (done < static_cast<int>(chunks)) std::this_thread::yield();
+        EXPECT_EQ(written, data.size());
+        EXPECT_TRUE(on_worker);
+
+        std::atomic<bool> synced(false);
+        io.Fsync(temp.file, [&synced](IoResult result) { synced = static_cast<bool>(result); });
+        while (!synced) std::this_thread::yield();
+
+        std::vector<char> back(data.size());
+        std::atomic<size_t> read(0);
+        done = 0;
+        for (size_t c = 0; c < chunks; c++)
+        {
+            io.Read(temp.file, back.data() + c * chunk, chunk, c * chunk, [&](IoResult result) {
+                read += result.bytes;
+                done++;
+            });
+        }
+        //past the end of the file
+        std::promise<IoResult> eof;
+        io.Read(temp.file, back.data(), chunk, data.size(), [&eof](IoResult result) { eof.set_value(result); });
+        auto at_end = eof.get_future().get();
+        while (done < static_cast<int>(chunks)) std::this_thread::yield();
+        EXPECT_EQ(read, data.size());
+        EXPECT_EQ(back, data);
+        EXPECT_TRUE(at_end);
+        EXPECT_EQ(at_end.bytes, 0u);
+    }
+}
+
+TEST(AsyncFileTests, ErrorTest)
+{
+    WorkerPool pool(2);
+    for (auto backend : { IoBackend::Auto, IoBackend::Threads })
+    {
+        TempFile temp;
+        std::promise<IoResult> failed;
+        {
+            AsyncFileIo io(pool, IoOptions{ backend });
+            char buffer[16];
+#if defined(_WIN32)
+            io.Read(INVALID_HANDLE_VALUE, buffer, sizeof(buffer), 0, [&failed](IoResult result) { failed.set_value(result); });
+#else
+            io.Read(-1, buffer, sizeof(buffer), 0, [&failed](IoResult result) { failed.set_value(result); });
+#endif
+            //the destructor waits for the callback
+        }
+        auto result = failed.get_future().get();
+        EXPECT_FALSE(result);
+        EXPECT_TRUE(result.error);
+    }
+}
+
+TEST(ExecutorTests, QuotaTest)
+{
+    EXPECT_EQ(&DefaultPool(), &DefaultPool());
+    EXPECT_EQ(DefaultPool().Capacity(), std::thread::hardware_concurrency());
+
+    WorkerPool pool(4);
+    constexpr int count = 200;
+    ExecutorView narrow(pool, ExecutorOptions{ 2 });
+    ExecutorView single(pool, ExecutorOptions{ 1 });
+    EXPECT_EQ(narrow.MaxConcurrency(), 2u);
+    EXPECT_EQ(ExecutorView(pool).MaxConcurrency(), 4u);
+
+    std::atomic<int> narrow_running(0), narrow_peak(0), single_running(0), single_peak(0);
+    auto track = [](std::atomic<int>& running, std::atomic<int>& peak) {
+        auto now = ++running;
+        for (auto p = peak.load(); now > p && !peak.compare_exchange_weak(p, now);) {}
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        --running;
+    };
+    for (int i = 0; i < count; i++)
+    {
+        narrow.Post([&] { track(narrow_running, narrow_peak); });
+        single.Post([&] { track(single_running, single_peak); });
+    }
+    auto sum = narrow.Submit([](int a, int b) { return a + b; }, 1, 2);
+    EXPECT_EQ(sum.Get(), 3);
+    EXPECT_THROW(narrow.Submit([] { throw std::runtime_error("view task failed"); }).Get(), std::runtime_error);
+    narrow.Wait();
+    single.Wait();
+
+    EXPECT_LE(narrow_peak, 2);
+    EXPECT_EQ(single_peak, 1);
+    auto stats = narrow.Stats();
+    EXPECT_EQ(stats.submitted, count + 2u);
+    EXPECT_EQ(stats.completed, count + 2u);
+    EXPECT_EQ(stats.failed, 1u);
+    EXPECT_EQ(stats.queued, 0u);
+    EXPECT_EQ(stats.running, 0u);
+    EXPECT_LE(stats.peak_running, 2u);
+    EXPECT_EQ(single.Stats().peak_running, 1u);
+    EXPECT_TRUE(narrow.IsIdle());
+}
+
+TEST(ExecutorTests, BusyViewFairnessTest)
+{
+    //same as BusyStrandFairnessTest, a view whose queue never runs dry goes back behind the pool's other tasks
+    PoolOptions options{ 1 };
+    options.mode = SchedulerMode::WorkStealing;
+    WorkerPool pool(options);
+    std::atomic<int> unrelated(0);
+    std::atomic<bool> stop(false);
+    bool timed_out = false;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    {
+        ExecutorView view(pool, ExecutorOptions{ 1 });
+        std::function<void()> busy = [&] {
+            if (std::chrono::steady_clock::now() >= deadline)
+                timed_out = true;
+            else if (!stop)
+                view.Post([&busy] { busy(); });
+        };
+        pool.AddTaskForExecution([&] {
+            for (int i = 0; i < 10; i++)
+                pool.Post([&] { if (++unrelated == 10) stop = true; });
+            view.Post([&busy] { busy(); });
+        }).wait();
+        while (!stop && std::chrono::steady_clock::now() < deadline) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(unrelated, 10);
+    EXPECT_FALSE(timed_out);
+}
+
+TEST(ExecutorTests, QueueDepthAndMetricsTest)
+{
+    WorkerPool pool(2);
+    ExecutorView view(pool, ExecutorOptions{ 1, 4 });
+
+    std::atomic<bool> gate(false);
+    std::atomic<bool> started(false);
+    view.Post([&] { started = true; while (!gate) std::this_thread::yield(); });
+    while (!started) std::this_thread::yield();
+
+    std::atomic<int> ran(0);
+    for (int i = 0; i < 4; i++)
+    {
+        EXPECT_TRUE(view.TryPost([&ran] { ran++; }));
+    }
+    Task extra([&ran] { ran++; });
+    EXPECT_FALSE(view.TryPost(std::move(extra)));
+    EXPECT_TRUE(extra); //handed back
+
+    auto stats = view.Stats();
+    EXPECT_EQ(stats.queued, 4u);
+    EXPECT_EQ(stats.running, 1u);
+    EXPECT_EQ(stats.rejected, 1u);
+    EXPECT_EQ(stats.peak_queued, 4u);
+
+    //waits for room
+    std::thread poster([&] {
+        view.Post([] { throw std::runtime_error("counted"); });
+        view.Post(std::move(extra));
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    gate = true;
+    poster.join();
+    view.Wait();
+
+    EXPECT_EQ(ran, 5);
+    stats = view.Stats();
+    EXPECT_EQ(stats.submitted, 7u);
+    EXPECT_EQ(stats.completed, 7u);
+    EXPECT_EQ(stats.failed, 1u);
+    EXPECT_LE(stats.peak_queued, 4u);
+    EXPECT_EQ(stats.peak_running, 1u);
+}
+
+TEST(ExecutorTests, PostToFullViewFromItsTaskTest)
+{
+    //the view's only drainer posts to its full queue, it can't wait for room it is the only one to make
+    WorkerPool pool(2);
+    ExecutorView view(pool, ExecutorOptions{ 1, 1 });
+    std::atomic<int> ran(0);
+    view.Post([&] {
+        view.Post([&ran] { ran++; });
+        view.Post([&ran] { ran++; });
+        ran++;
+    });
+    view.Wait();
+    EXPECT_EQ(ran, 3);
+    EXPECT_EQ(view.Stats().peak_queued, 2u);
+}
+
+TEST(WorkerLocalTests, CombineAndForEachTest)
+{
+    for (auto mode : { SchedulerMode::GlobalQueue, SchedulerMode::WorkStealing })
+    {
+        WorkerPool pool(PoolOptions{ 4, mode });
+        Combinable<long long> sums(pool);
+        std::vector<int> values(100'000);
+        std::iota(values.begin(), values.end(), 1);
+        //the calling thread runs pieces too and gets its own instance
+        ParallelFor(pool, values.begin(), values.end(), [&sums](int value) { sums.Local() += value; });
+        EXPECT_EQ(sums.Combine(std::plus<long long>()), 100'000ll * 100'001 / 2);
+
+        size_t instances = 0;
+        sums.ForEach([&instances](long long&) { instances++; });
+        EXPECT_GE(instances, 1u);
+        EXPECT_LE(instances, pool.Capacity() + 1);
+
+        sums.Clear();
+        EXPECT_EQ(sums.Combine(std::plus<long long>()), 0);
+
+        //every worker fills its own vector, made by the factory
+        WorkerLocal<std::vector<int>> seen(pool, [] { std::vector<int> v; v.reserve(64); return v; });
+        pool.SubmitBatch(1'000, [&seen](size_t i) { return [&seen, i] { seen.Local().push_back(static_cast<int>(i)); }; }).Wait();
+        std::vector<int> all;
+        seen.ForEach([&all](std::vector<int>& part) { all.insert(all.end(), part.begin(), part.end()); });
+        std::sort(all.begin(), all.end());
+        ASSERT_EQ(all.size(), 1'000u);
+        for (int i = 0; i < 1'000; i++) EXPECT_EQ(all[i], i);
+    }
+}